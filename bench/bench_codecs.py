@@ -0,0 +1,68 @@
+# bench_codecs.py - compress every corpus file with each codec, check the
+# round trip and report size and speed. results also go to a csv.
+# usage: python3 bench/bench_codecs.py [corpus_dir] [codec ...]
+import csv
+import filecmp
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+here = os.path.dirname(os.path.abspath(__file__))
+binary = os.path.join(here, '..', 'parallel_bzip2')
+corpus = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, 'corpus')
+codecs = sys.argv[2:] or ['bz2:9', 'bwt-fast']
+runs = int(os.environ.get('BENCH_RUNS', '3'))
+results_dir = os.path.join(here, 'results')
+os.makedirs(results_dir, exist_ok=True)
+
+
+# best wall time of a few runs - the least disturbed one
+def timed(args):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run(args, check=True, stdout=subprocess.DEVNULL)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+rows = []
+files = sorted(f for f in os.listdir(corpus) if os.path.isfile(os.path.join(corpus, f)))
+if not files:
+    sys.exit(f'no corpus in {corpus} - run bench/make_corpus.py first')
+with tempfile.TemporaryDirectory() as tmp:
+    for name in files:
+        path = os.path.join(corpus, name)
+        size = os.path.getsize(path)
+        for codec in codecs:
+            archive = os.path.join(tmp, 'archive')
+            restored = os.path.join(tmp, 'restored')
+            compress_time = timed([binary, '--codec', codec, path, archive])
+            decompress_time = timed([binary, '-d', archive, restored])
+            compressed = os.path.getsize(archive)
+            rows.append({
+                'file': name,
+                'codec': codec,
+                'original_bytes': size,
+                'compressed_bytes': compressed,
+                'ratio': round(size / compressed, 3),
+                'compress_mb_s': round(size / 1e6 / compress_time, 2),
+                'decompress_mb_s': round(size / 1e6 / decompress_time, 2),
+                'roundtrip': 'ok' if filecmp.cmp(path, restored, shallow=False) else 'FAILED',
+            })
+
+print(f"{'file':<14} {'codec':<10} {'ratio':>7} {'comp MB/s':>10} {'decomp MB/s':>12}  roundtrip")
+for row in rows:
+    print(f"{row['file']:<14} {row['codec']:<10} {row['ratio']:>7.3f} "
+          f"{row['compress_mb_s']:>10.2f} {row['decompress_mb_s']:>12.2f}  {row['roundtrip']}")
+out = os.path.join(results_dir, 'codecs.csv')
+with open(out, 'w', newline='') as f:
+    writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+    writer.writeheader()
+    writer.writerows(rows)
+print(f'results written to {out}')
+if any(row['roundtrip'] != 'ok' for row in rows):
+    sys.exit(1)
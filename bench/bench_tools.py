@@ -0,0 +1,157 @@
+# bench_tools.py - both of our binaries against bzip2, pbzip2 and lbzip2 on
+# the same corpus and thread counts. reports compress / decompress speed,
+# ratio, peak RSS and whether plain bzip2 and our -d read each archive.
+# tools that aren't installed are skipped. results also go to a csv that
+# create_graphs.py plots.
+# usage: python3 bench/bench_tools.py [corpus_dir] [threads ...]
+import csv
+import filecmp
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+here = os.path.dirname(os.path.abspath(__file__))
+ours = os.path.abspath(os.path.join(here, '..', 'parallel_bzip2'))
+ours_mem = os.path.abspath(os.path.join(here, '..', 'parallel_bzip2_mem'))
+corpus = sys.argv[1] if len(sys.argv) > 1 else os.path.join(here, 'corpus')
+thread_counts = [int(t) for t in sys.argv[2:]] or sorted({1, os.cpu_count() or 1})
+runs = int(os.environ.get('BENCH_RUNS', '3'))
+results_dir = os.path.join(here, 'results')
+os.makedirs(results_dir, exist_ok=True)
+
+
+# how each tool compresses and decompresses with n threads - commands that
+# write to stdout get it redirected to the output file. no decompress means
+# the tool can't, and the column stays empty
+def tools():
+    found = []
+    if os.path.exists(ours):
+        found.append(('parallel_bzip2', False,
+                      lambda i, o, n: [ours, i, o],
+                      lambda i, o, n: [ours, '-d', i, o]))
+    if os.path.exists(ours_mem):
+        found.append(('parallel_bzip2_mem', False,
+                      lambda i, o, n: [ours_mem, i, o],
+                      None))
+    if shutil.which('bzip2'):
+        found.append(('bzip2', True,
+                      lambda i, o, n: ['bzip2', '-9', '-c', i],
+                      lambda i, o, n: ['bzip2', '-d', '-c', i]))
+    if shutil.which('pbzip2'):
+        found.append(('pbzip2', True,
+                      lambda i, o, n: ['pbzip2', '-9', '-c', f'-p{n}', i],
+                      lambda i, o, n: ['pbzip2', '-d', '-c', f'-p{n}', i]))
+    if shutil.which('lbzip2'):
+        found.append(('lbzip2', True,
+                      lambda i, o, n: ['lbzip2', '-9', '-c', '-n', str(n), i],
+                      lambda i, o, n: ['lbzip2', '-d', '-c', '-n', str(n), i]))
+    return found
+
+
+# wall time and peak RSS (KB) of one run - wait4 gives the child's own
+# max resident set, not ours
+def measure(args, output, to_stdout, nthreads):
+    env = dict(os.environ, OMP_NUM_THREADS=str(nthreads))
+    with open(output if to_stdout else os.devnull, 'wb') as out:
+        start = time.perf_counter()
+        proc = subprocess.Popen(args, stdout=out, env=env)
+        _, status, usage = os.wait4(proc.pid, 0)
+        elapsed = time.perf_counter() - start
+    proc.returncode = os.waitstatus_to_exitcode(status)
+    if proc.returncode != 0:
+        raise subprocess.CalledProcessError(proc.returncode, args)
+    return elapsed, usage.ru_maxrss
+
+
+# best wall time of a few runs - the least disturbed one, and the most
+# memory any of them took
+def timed(args, output, to_stdout, nthreads):
+    best, peak = None, 0
+    for _ in range(runs):
+        elapsed, rss = measure(args, output, to_stdout, nthreads)
+        best = elapsed if best is None else min(best, elapsed)
+        peak = max(peak, rss)
+    return best, peak
+
+
+# does a reference decoder give back the original
+def reads_back(args, original, restored, to_stdout):
+    try:
+        measure(args, restored, to_stdout, 1)
+    except subprocess.CalledProcessError:
+        return 'FAILED'
+    return 'ok' if filecmp.cmp(original, restored, shallow=False) else 'FAILED'
+
+
+def mb_s(size, seconds):
+    return round(size / 1e6 / seconds, 2)
+
+
+found = tools()
+if not found:
+    sys.exit('nothing to benchmark - build parallel_bzip2 first')
+print('tools: ' + ', '.join(name for name, *_ in found))
+files = sorted(f for f in os.listdir(corpus) if os.path.isfile(os.path.join(corpus, f)))
+if not files:
+    sys.exit(f'no corpus in {corpus} - run bench/make_corpus.py first')
+rows = []
+with tempfile.TemporaryDirectory() as tmp:
+    archive = os.path.join(tmp, 'archive')
+    restored = os.path.join(tmp, 'restored')
+    for name in files:
+        path = os.path.join(corpus, name)
+        size = os.path.getsize(path)
+        for threads in thread_counts:
+            for tool, to_stdout, compress, decompress in found:
+                compress_time, compress_rss = timed(compress(path, archive, threads), archive,
+                                                    to_stdout, threads)
+                compressed = os.path.getsize(archive)
+                row = {
+                    'file': name,
+                    'tool': tool,
+                    'threads': threads,
+                    'original_bytes': size,
+                    'compressed_bytes': compressed,
+                    'ratio': round(size / compressed, 3),
+                    'compress_mb_s': mb_s(size, compress_time),
+                    'decompress_mb_s': '',
+                    'compress_rss_kb': compress_rss,
+                    'decompress_rss_kb': '',
+                    'roundtrip': '',
+                }
+                if decompress:
+                    decompress_time, decompress_rss = timed(decompress(archive, restored, threads),
+                                                            restored, to_stdout, threads)
+                    row['decompress_mb_s'] = mb_s(size, decompress_time)
+                    row['decompress_rss_kb'] = decompress_rss
+                    row['roundtrip'] = 'ok' if filecmp.cmp(path, restored, shallow=False) else 'FAILED'
+                # the archive has to work with stock bzip2 and with our -d
+                if shutil.which('bzip2'):
+                    row['bzip2_reads'] = reads_back(['bzip2', '-d', '-c', archive], path,
+                                                    restored, True)
+                else:
+                    row['bzip2_reads'] = ''
+                row['ours_reads'] = reads_back([ours, '-d', archive, restored], path,
+                                               restored, False) if os.path.exists(ours) else ''
+                rows.append(row)
+
+print(f"{'file':<14} {'tool':<18} {'thr':>3} {'ratio':>6} {'comp MB/s':>10} {'decomp MB/s':>12} "
+      f"{'comp RSS MB':>12} {'decomp RSS MB':>14}  bzip2  ours")
+for row in rows:
+    decomp = f"{row['decompress_mb_s']:>12.2f}" if row['decompress_mb_s'] != '' else f"{'-':>12}"
+    decomp_rss = (f"{row['decompress_rss_kb'] / 1024:>14.1f}" if row['decompress_rss_kb'] != ''
+                  else f"{'-':>14}")
+    print(f"{row['file']:<14} {row['tool']:<18} {row['threads']:>3} {row['ratio']:>6.3f} "
+          f"{row['compress_mb_s']:>10.2f} {decomp} {row['compress_rss_kb'] / 1024:>12.1f} "
+          f"{decomp_rss}  {row['bzip2_reads'] or '-':<6} {row['ours_reads'] or '-'}")
+out = os.path.join(results_dir, 'tools.csv')
+with open(out, 'w', newline='') as f:
+    writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+    writer.writeheader()
+    writer.writerows(rows)
+print(f'results written to {out}')
+if any('FAILED' in (row['roundtrip'], row['bzip2_reads'], row['ours_reads']) for row in rows):
+    sys.exit(1)
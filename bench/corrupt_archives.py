@@ -0,0 +1,100 @@
+# corrupt_archives.py - feed -d hand made hostile bwt-huff payloads and
+# bit flipped copies of a real archive. every one must be refused or
+# decoded cleanly, never crash - build with -fsanitize=address to also
+# catch out of bounds accesses that don't happen to crash
+# usage: python3 bench/corrupt_archives.py [binary] [input_file]
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+
+CODEC_BWT_HUFF = 3
+BWT_HUFFMAN = 2
+HUFF_ALPHABET = 257
+
+binary = sys.argv[1] if len(sys.argv) > 1 else './parallel_bzip2'
+source = sys.argv[2] if len(sys.argv) > 2 else None
+
+
+class Bits:
+    def __init__(self):
+        self.bits = []
+
+    def put(self, n, value):
+        self.bits += [(value >> (n - 1 - i)) & 1 for i in range(n)]
+
+    def bytes(self, pad=64):
+        bits = self.bits + [0] * (-len(self.bits) % 8)
+        data = bytes(int(''.join(map(str, bits[i:i + 8])), 2) for i in range(0, len(bits), 8))
+        return data + bytes(pad)
+
+
+# a container holding one bwt-huff block with the given huffman payload
+def container(payload, original_size=64):
+    block = bytes([BWT_HUFFMAN]) + struct.pack('<I', 0) + payload
+    header = b'PBZC' + bytes([1, 0, 0, 0]) + struct.pack('<I', 0)
+    block_header = struct.pack('<III', original_size, original_size, len(block)) + \
+                   bytes([CODEC_BWT_HUFF, 0, 0, 0])
+    return header + block_header + block + bytes(16)
+
+
+def huffman_header(count, tables):
+    return struct.pack('<IBI', count, tables, (count + 49) // 50)
+
+
+# every code length 1 - far more codes than one bit can hold
+def overfull_lengths():
+    bits = Bits()
+    bits.put(1, 0)  # selector: table 0
+    for _ in range(2):
+        bits.put(5, 1)
+        for _ in range(HUFF_ALPHABET):
+            bits.put(1, 0)
+    return container(huffman_header(50, 2) + bits.bytes())
+
+
+# a selector whose unary run goes past the last table
+def selector_overrun():
+    return container(huffman_header(50, 2) + b'\xff' * 64)
+
+
+def run(data, name):
+    with tempfile.TemporaryDirectory() as tmp:
+        path = os.path.join(tmp, 'in')
+        with open(path, 'wb') as f:
+            f.write(data)
+        proc = subprocess.run([binary, '-d', path, os.path.join(tmp, 'out')],
+                              stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    # a signal, or a sanitizer report, is a failure - refusing is fine
+    if proc.returncode < 0 or b'Sanitizer' in proc.stderr:
+        sys.exit(f'{name}: -d crashed ({proc.returncode})\n{proc.stderr.decode(errors="replace")}')
+    return proc.returncode
+
+
+failures = 0
+for name, data in [('overfull lengths', overfull_lengths()),
+                   ('selector overrun', selector_overrun())]:
+    if run(data, name) == 0:
+        print(f'{name}: corrupt payload was accepted')
+        failures += 1
+# random flips of a real archive, seeded so a failure can be replayed
+if source:
+    with tempfile.TemporaryDirectory() as tmp:
+        archive = os.path.join(tmp, 'a.pbz')
+        subprocess.run([binary, '-b', '64', '--codec', 'bwt-huff:3', source, archive],
+                       stdout=subprocess.DEVNULL, check=True)
+        with open(archive, 'rb') as f:
+            original = f.read()
+    rng = random.Random(1)
+    for trial in range(200):
+        data = bytearray(original)
+        for _ in range(rng.randint(1, 8)):
+            # past the container and block headers, into the payload
+            at = rng.randrange(28, len(data))
+            data[at] ^= 1 << rng.randrange(8)
+        run(bytes(data), f'bit flips, trial {trial}')
+if failures:
+    sys.exit(1)
+print('corrupt archives: all refused without crashing')
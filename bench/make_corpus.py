@@ -0,0 +1,117 @@
+# make_corpus.py - synthetic stand-ins for the data we compress, so codec
+# benchmarks are repeatable without shipping real logs or dumps.
+# usage: python3 bench/make_corpus.py [size_mb] [out_dir]
+import json
+import os
+import random
+import struct
+import sys
+
+size_mb = int(sys.argv[1]) if len(sys.argv) > 1 else 16
+out_dir = sys.argv[2] if len(sys.argv) > 2 else os.path.join(os.path.dirname(__file__), 'corpus')
+target = size_mb * 1024 * 1024
+os.makedirs(out_dir, exist_ok=True)
+# same corpus every run
+rng = random.Random(42)
+
+WORDS = ('the of and to in is was for on that with as by at from it be this are have '
+         'not or which an had but were all their one has been there more would can if '
+         'its when other into some than only time then so about new these out two first '
+         'system block data file stream server request thread buffer memory disk read '
+         'write cache queue error value table index record field offset length').split()
+
+
+def write(name, chunks):
+    path = os.path.join(out_dir, name)
+    written = 0
+    with open(path, 'wb') as f:
+        for chunk in chunks:
+            f.write(chunk)
+            written += len(chunk)
+            if written >= target:
+                break
+    print(f'{path}: {written} bytes')
+
+
+# service logs - a few dozen templates with varying fields
+def logs():
+    levels = ['INFO'] * 8 + ['WARN', 'ERROR']
+    templates = [
+        'request id={id} took {ms}ms path=/api/v{v}/{word}/{n} status={status}',
+        'connection from 10.{a}.{b}.{c}:{port} accepted',
+        'cache {word} hit ratio {pct}% size={n}',
+        'user {user} logged in from 192.168.{a}.{b}',
+        'flushed {n} records to disk in {ms}ms',
+        'retrying {word} after {ms}ms (attempt {v})',
+    ]
+    t = 1_700_000_000
+    seq = 0
+    while True:
+        lines = []
+        for _ in range(1000):
+            t += rng.randint(0, 3)
+            seq += 1
+            fields = {
+                'id': seq, 'ms': rng.randint(1, 900), 'v': rng.randint(1, 3),
+                'word': rng.choice(WORDS), 'n': rng.randint(0, 99999),
+                'status': rng.choice([200] * 9 + [404, 500]), 'a': rng.randint(0, 255),
+                'b': rng.randint(0, 255), 'c': rng.randint(0, 255),
+                'port': rng.randint(1024, 65535), 'pct': rng.randint(0, 100),
+                'user': 'user%04d' % rng.randint(0, 5000),
+            }
+            message = rng.choice(templates).format(**fields)
+            lines.append(f'{t} {rng.choice(levels)} worker[{rng.randint(1, 16)}] {message}\n')
+        yield ''.join(lines).encode()
+
+
+# newline delimited json records
+def records():
+    while True:
+        rows = []
+        for _ in range(500):
+            rows.append(json.dumps({
+                'id': rng.randint(0, 10**9),
+                'name': ' '.join(rng.choice(WORDS) for _ in range(rng.randint(1, 4))),
+                'price': round(rng.uniform(0, 1000), 2),
+                'tags': rng.sample(WORDS, rng.randint(0, 4)),
+                'active': rng.random() < 0.8,
+            }) + '\n')
+        yield ''.join(rows).encode()
+
+
+# word salad with a skewed vocabulary - natural-ish text statistics
+def text():
+    weights = [1.0 / (i + 1) for i in range(len(WORDS))]
+    while True:
+        words = rng.choices(WORDS, weights, k=20000)
+        out = []
+        for i, word in enumerate(words):
+            out.append(word)
+            out.append('.\n' if i % 17 == 16 else ' ')
+        yield ''.join(out).encode()
+
+
+# fixed size binary records - ints that count up, floats that drift
+def binary():
+    key = 0
+    value = 0.0
+    while True:
+        out = bytearray()
+        for _ in range(4096):
+            key += rng.randint(1, 4)
+            value += rng.gauss(0, 1)
+            out += struct.pack('<IIdh2x', key, rng.randint(0, 7), value, rng.randint(-100, 100))
+        yield bytes(out)
+
+
+# incompressible
+def noise():
+    while True:
+        yield rng.randbytes(1 << 20)
+
+
+write('logs.txt', logs())
+write('records.json', records())
+write('text.txt', text())
+write('binary.bin', binary())
+write('random.bin', noise())
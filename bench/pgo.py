@@ -0,0 +1,96 @@
+# pgo.py - the two halves of `make pgo`: run an instrumented binary over
+# the corpus so gcc has a profile, then time the plain and optimized builds
+# against each other.
+# usage: python3 bench/pgo.py train <binary> [corpus_dir]
+#        python3 bench/pgo.py compare <plain_binary> <pgo_binary> [corpus_dir]
+import filecmp
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+here = os.path.dirname(os.path.abspath(__file__))
+runs = int(os.environ.get('BENCH_RUNS', '3'))
+# what the fleet runs - default and small blocks, one thread and all of them
+block_sizes = [100, 900]
+threads = sorted({1, 2, os.cpu_count() or 1})
+codecs = ['bz2:9', 'bwt-huff']
+
+
+def corpus_files(corpus):
+    files = sorted(os.path.join(corpus, f) for f in os.listdir(corpus)
+                   if os.path.isfile(os.path.join(corpus, f)))
+    if not files:
+        sys.exit(f'no corpus in {corpus} - run bench/make_corpus.py first')
+    return files
+
+
+def run(args, nthreads):
+    env = dict(os.environ, OMP_NUM_THREADS=str(nthreads))
+    subprocess.run(args, check=True, stdout=subprocess.DEVNULL, env=env)
+
+
+# every code path the profile should know about: each codec, block size and
+# thread count, and decompressing what came out
+def train(binary, corpus):
+    with tempfile.TemporaryDirectory() as tmp:
+        archive = os.path.join(tmp, 'archive')
+        restored = os.path.join(tmp, 'restored')
+        for path in corpus_files(corpus):
+            for codec in codecs:
+                for block in block_sizes:
+                    for n in threads:
+                        print(f'train {os.path.basename(path)} {codec} -b {block} x{n}')
+                        run([binary, '--codec', codec, '-b', str(block), path, archive], n)
+                        run([binary, '-d', archive, restored], n)
+
+
+# best wall time of a few runs - the least disturbed one
+def timed(args, nthreads):
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        run(args, nthreads)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def compare(plain, optimized, corpus):
+    n = threads[-1]
+    totals = {plain: [0.0, 0.0], optimized: [0.0, 0.0]}
+    print(f"{'file':<14} {'build':<6} {'comp s':>8} {'decomp s':>9}")
+    with tempfile.TemporaryDirectory() as tmp:
+        for path in corpus_files(corpus):
+            outputs = []
+            for binary in (plain, optimized):
+                archive = os.path.join(tmp, os.path.basename(binary) + '.out')
+                restored = os.path.join(tmp, 'restored')
+                compress_time = timed([binary, path, archive], n)
+                decompress_time = timed([binary, '-d', archive, restored], n)
+                if not filecmp.cmp(path, restored, shallow=False):
+                    sys.exit(f'{binary}: round trip of {path} FAILED')
+                totals[binary][0] += compress_time
+                totals[binary][1] += decompress_time
+                outputs.append(archive)
+                label = 'plain' if binary == plain else 'pgo'
+                print(f'{os.path.basename(path):<14} {label:<6} {compress_time:>8.3f} '
+                      f'{decompress_time:>9.3f}')
+            # same code, same archive - only the speed may differ
+            if not filecmp.cmp(outputs[0], outputs[1], shallow=False):
+                sys.exit(f'plain and pgo builds disagree on {path}')
+    comp = totals[plain][0] / totals[optimized][0]
+    decomp = totals[plain][1] / totals[optimized][1]
+    print(f'speedup with {n} threads: compress {comp:.3f}x, decompress {decomp:.3f}x')
+
+
+if len(sys.argv) < 3 or sys.argv[1] not in ('train', 'compare'):
+    sys.exit('usage: pgo.py train <binary> [corpus_dir] | compare <plain> <pgo> [corpus_dir]')
+if sys.argv[1] == 'train':
+    train(sys.argv[2], sys.argv[3] if len(sys.argv) > 3 else os.path.join(here, 'corpus'))
+else:
+    if len(sys.argv) < 4:
+        sys.exit('usage: pgo.py compare <plain_binary> <pgo_binary> [corpus_dir]')
+    compare(sys.argv[2], sys.argv[3],
+            sys.argv[4] if len(sys.argv) > 4 else os.path.join(here, 'corpus'))
@@ -0,0 +1,206 @@
+# scaling.py - fit Amdahl's law and the Universal Scalability Law to a
+# thread sweep, so the serial fraction and the contention / coherency
+# costs are numbers we can track instead of a shape on a graph.
+#   amdahl:  S(N) = N / (1 + s (N - 1))
+#   usl:     S(N) = N / (1 + sigma (N - 1) + kappa N (N - 1))
+# both are linear in their coefficients once rearranged, so a plain least
+# squares solve does - no numpy needed.
+# usage: python3 bench/scaling.py sweep [input_file] [threads ...]
+#        python3 bench/scaling.py fit <csv> [--baseline fit.json]
+# the csv needs a threads column and one of speedup, mb_s or seconds.
+import csv
+import json
+import math
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+here = os.path.dirname(os.path.abspath(__file__))
+binary = os.path.join(here, '..', 'parallel_bzip2')
+runs = int(os.environ.get('BENCH_RUNS', '3'))
+results_dir = os.path.join(here, 'results')
+# a serial fraction this much above the baseline fails the run
+REGRESSION = 0.02
+
+
+# best wall time of compressing path with n threads
+def timed(path, archive, threads):
+    env = dict(os.environ, OMP_NUM_THREADS=str(threads))
+    best = None
+    for _ in range(runs):
+        start = time.perf_counter()
+        subprocess.run([binary, path, archive], check=True, stdout=subprocess.DEVNULL, env=env)
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+    return best
+
+
+def sweep(path, thread_counts):
+    size = os.path.getsize(path)
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for n in thread_counts:
+            seconds = timed(path, os.path.join(tmp, 'archive'), n)
+            rows.append({'threads': n, 'seconds': round(seconds, 4),
+                         'mb_s': round(size / 1e6 / seconds, 2)})
+            print(f'{n:>4} threads {rows[-1]["mb_s"]:>9.2f} MB/s')
+    os.makedirs(results_dir, exist_ok=True)
+    out = os.path.join(results_dir, 'scaling.csv')
+    with open(out, 'w', newline='') as f:
+        writer = csv.DictWriter(f, fieldnames=list(rows[0]))
+        writer.writeheader()
+        writer.writerows(rows)
+    print(f'results written to {out}')
+    return out
+
+
+# speedup over the single thread point, from whichever column the csv has
+def load_speedups(path):
+    with open(path) as f:
+        rows = list(csv.DictReader(f))
+    points = {}
+    for row in rows:
+        n = int(row['threads'])
+        if row.get('speedup'):
+            points[n] = float(row['speedup'])
+        elif row.get('mb_s'):
+            points[n] = float(row['mb_s'])
+        else:
+            points[n] = 1 / float(row['seconds'])
+    if 1 not in points:
+        sys.exit(f'{path}: the sweep needs a 1 thread point to measure speedup against')
+    base = points[1]
+    return sorted((n, value / base) for n, value in points.items())
+
+
+# least squares through the origin: y = a x
+def fit_one(xs, ys):
+    sxx = sum(x * x for x in xs)
+    return sum(x * y for x, y in zip(xs, ys)) / sxx if sxx else 0.0
+
+
+# least squares through the origin: y = a x1 + b x2, from the normal equations
+def fit_two(x1, x2, ys):
+    s11 = sum(a * a for a in x1)
+    s22 = sum(b * b for b in x2)
+    s12 = sum(a * b for a, b in zip(x1, x2))
+    s1y = sum(a * y for a, y in zip(x1, ys))
+    s2y = sum(b * y for b, y in zip(x2, ys))
+    det = s11 * s22 - s12 * s12
+    if abs(det) < 1e-12:
+        return fit_one(x1, ys), 0.0
+    return (s1y * s22 - s2y * s12) / det, (s2y * s11 - s1y * s12) / det
+
+
+# N / S - 1 = s (N - 1)
+def fit_amdahl(points):
+    xs = [n - 1 for n, _ in points]
+    ys = [n / speedup - 1 for n, speedup in points]
+    return min(max(fit_one(xs, ys), 0.0), 1.0)
+
+
+# N / S - 1 = sigma (N - 1) + kappa N (N - 1). a negative coefficient
+# means the data can't support it - refit with it held at 0
+def fit_usl(points):
+    x1 = [n - 1 for n, _ in points]
+    x2 = [n * (n - 1) for n, _ in points]
+    ys = [n / speedup - 1 for n, speedup in points]
+    sigma, kappa = fit_two(x1, x2, ys)
+    if kappa < 0:
+        sigma, kappa = fit_one(x1, ys), 0.0
+    if sigma < 0:
+        sigma, kappa = 0.0, max(fit_one(x2, ys), 0.0)
+    return sigma, kappa
+
+
+def amdahl(n, s):
+    return n / (1 + s * (n - 1))
+
+
+def usl(n, sigma, kappa):
+    return n / (1 + sigma * (n - 1) + kappa * n * (n - 1))
+
+
+def r_squared(points, model):
+    mean = sum(speedup for _, speedup in points) / len(points)
+    total = sum((speedup - mean) ** 2 for _, speedup in points)
+    residual = sum((speedup - model(n)) ** 2 for n, speedup in points)
+    return 1 - residual / total if total else 1.0
+
+
+def fit(path, baseline=None):
+    points = load_speedups(path)
+    if len(points) < 3:
+        sys.exit(f'{path}: need at least 3 thread counts to fit two coefficients')
+    s = fit_amdahl(points)
+    sigma, kappa = fit_usl(points)
+    # the usl curve peaks where its derivative is 0 - with no coherency
+    # cost it keeps climbing and more threads never hurt, and with sigma
+    # at 1 or more a second thread already loses
+    if sigma >= 1:
+        peak = 1
+    elif kappa > 0:
+        peak = max(1, round(math.sqrt((1 - sigma) / kappa)))
+    else:
+        peak = None
+    print(f"{'threads':>7} {'speedup':>8} {'eff %':>6} {'amdahl':>7} {'usl':>7}")
+    for n, speedup in points:
+        note = '  superlinear - cache effects or a slow 1 thread run' if speedup > n * 1.02 else ''
+        print(f'{n:>7} {speedup:>8.2f} {100 * speedup / n:>6.1f} {amdahl(n, s):>7.2f} '
+              f'{usl(n, sigma, kappa):>7.2f}{note}')
+    result = {
+        'machine': os.uname().nodename,
+        'cpus': os.cpu_count(),
+        'serial_fraction': round(s, 5),
+        'amdahl_limit': round(1 / s, 2) if s > 0 else None,
+        'amdahl_r2': round(r_squared(points, lambda n: amdahl(n, s)), 4),
+        'contention': round(sigma, 5),
+        'coherency': round(kappa, 7),
+        'usl_r2': round(r_squared(points, lambda n: usl(n, sigma, kappa)), 4),
+        'optimal_threads': peak,
+        'peak_speedup': round(usl(peak, sigma, kappa), 2) if peak else None,
+    }
+    print(f"amdahl: serial fraction {result['serial_fraction']:.4f}, "
+          f"speedup limit {result['amdahl_limit']}, R^2 {result['amdahl_r2']}")
+    print(f"usl: contention {result['contention']:.4f}, coherency {result['coherency']:.6f}, "
+          f"R^2 {result['usl_r2']}")
+    if peak:
+        print(f'optimal thread count {peak} (predicted speedup {result["peak_speedup"]})')
+    else:
+        print('no coherency cost measured - throughput keeps rising with threads')
+    os.makedirs(results_dir, exist_ok=True)
+    out = os.path.join(results_dir, 'scaling_fit.json')
+    with open(out, 'w') as f:
+        json.dump(result, f, indent=2)
+    print(f'fit written to {out}')
+    if baseline:
+        with open(baseline) as f:
+            before = json.load(f)
+        grown = result['serial_fraction'] - before['serial_fraction']
+        if grown > REGRESSION:
+            sys.exit(f"serial fraction regressed: {before['serial_fraction']:.4f} -> "
+                     f"{result['serial_fraction']:.4f}")
+        print(f"serial fraction vs baseline: {before['serial_fraction']:.4f} -> "
+              f"{result['serial_fraction']:.4f}")
+
+
+if len(sys.argv) < 2 or sys.argv[1] not in ('sweep', 'fit'):
+    sys.exit('usage: scaling.py sweep [input_file] [threads ...] | fit <csv> [--baseline fit.json]')
+if sys.argv[1] == 'sweep':
+    args = sys.argv[2:]
+    path = args.pop(0) if args else os.path.join(here, 'corpus', 'text.txt')
+    cpus = os.cpu_count() or 1
+    threads = [int(t) for t in args] or sorted({1, 2, 4, 8, 16, 32, cpus, 2 * cpus})
+    fit(sweep(path, threads))
+else:
+    if len(sys.argv) < 3:
+        sys.exit('usage: scaling.py fit <csv> [--baseline fit.json]')
+    baseline = None
+    if '--baseline' in sys.argv:
+        at = sys.argv.index('--baseline')
+        if at + 1 >= len(sys.argv):
+            sys.exit('--baseline needs a fit.json')
+        baseline = sys.argv[at + 1]
+    fit(sys.argv[2], baseline)
@@ -0,0 +1,264 @@
+# simulate.py - replay a --trace of per block costs under other scheduling
+# policies, thread counts and reorder windows, and predict makespan and
+# peak memory - so ideas can be compared without rerunning on hardware.
+#
+# the model is the streaming pipeline: one reader hands blocks out in file
+# order, threads compress them, and one writer writes them back in order.
+# a compressed block waits for the writer while blocks before it are still
+# being compressed. the reorder window caps how far the reader may run ahead
+# of the writer, which is what bounds memory. a block holds its input from
+# the read until it is compressed, and its output until it is written.
+#
+# policies:
+#   dynamic   next block in file order to whichever thread is free (omp dynamic)
+#   static    contiguous equal shares of blocks per thread (omp static)
+#   cost      longest block first to whichever thread is free (LPT)
+#   stealing  static shares, idle threads steal from the far end of the
+#             fullest share
+#   numa      threads split over --nodes nodes, each node works through its
+#             own contiguous part of the file and never takes remote blocks
+# --remote-penalty slows a block run on a node other than its home node
+# (the node whose part of the file it is in) for the unpinned policies.
+# --slowdown adds that fraction of a block's cost per extra thread, for
+# shared cache / memory bandwidth (the usl contention of bench/scaling.py).
+#
+# usage: python3 bench/simulate.py <trace.csv> [--threads 1,2,4] [--window 4,16,0]
+#            [--policies dynamic,cost] [--nodes 2] [--remote-penalty 0.3] [--slowdown 0]
+# a window of 0 means unbounded.
+import argparse
+import bisect
+import collections
+import csv
+import heapq
+import sys
+
+POLICIES = ['dynamic', 'static', 'cost', 'stealing', 'numa']
+
+
+# one row per block - the costs of all its targets run back to back, as
+# the compressor hands them out together
+def load_trace(path):
+    info = {}
+    blocks = {}
+    with open(path) as f:
+        lines = []
+        for line in f:
+            if line.startswith('#'):
+                words = line[1:].split()
+                for key, value in zip(words[::2], words[1::2]):
+                    try:
+                        info[key] = float(value)
+                    except ValueError:
+                        pass
+            else:
+                lines.append(line)
+    for row in csv.DictReader(lines):
+        i = int(row['block'])
+        block = blocks.setdefault(i, {'cost': 0.0, 'write': 0.0, 'in': int(row['original_size']),
+                                      'out': 0, 'end': 0.0})
+        block['cost'] += float(row['compress_seconds'])
+        block['write'] += float(row['write_seconds'])
+        block['out'] += int(row['compressed_size'])
+        block['end'] = max(block['end'], float(row['end']))
+    if not blocks:
+        sys.exit(f'{path}: no blocks in trace')
+    ordered = [blocks[i] for i in sorted(blocks)]
+    total_in = sum(b['in'] for b in ordered)
+    # the trace reads the file in one go - spread it over the blocks by size
+    read_seconds = info.get('read_seconds', 0.0)
+    for b in ordered:
+        b['read'] = read_seconds * b['in'] / total_in if total_in else 0.0
+    return info, ordered
+
+
+def home_node(block, n, nodes):
+    return min(block * nodes // n, nodes - 1)
+
+
+def shares(n, parts):
+    bounds = [n * p // parts for p in range(parts + 1)]
+    return [collections.deque(range(bounds[p], bounds[p + 1])) for p in range(parts)]
+
+
+# hands a free thread its next block. reads land in file order, so the
+# blocks that are ready are always the ones below ready_limit
+class Policy:
+    def __init__(self, name, blocks, threads, nodes):
+        self.name = name
+        self.blocks = blocks
+        self.n = len(blocks)
+        self.threads = threads
+        # fewer threads than nodes leaves the extra nodes empty
+        self.nodes = min(nodes, threads)
+        self.next = 0  # dynamic: next block in order; cost: next to push
+        self.heap = []
+        self.left = self.n
+        if name in ('static', 'stealing'):
+            self.own = shares(self.n, threads)
+        elif name == 'numa':
+            # a node's threads share its part of the file
+            parts = shares(self.n, self.nodes)
+            self.own = [parts[self.node(t)] for t in range(threads)]
+
+    def node(self, thread):
+        return min(thread * self.nodes // self.threads, self.nodes - 1)
+
+    def has_work(self, thread):
+        if self.name in ('dynamic', 'cost'):
+            return self.left > 0
+        if self.name == 'stealing':
+            return any(self.own)
+        return bool(self.own[thread])
+
+    def pick(self, thread, ready_limit):
+        block = None
+        if self.name == 'dynamic':
+            if self.next < ready_limit:
+                block = self.next
+                self.next += 1
+        elif self.name == 'cost':
+            while self.next < ready_limit:
+                heapq.heappush(self.heap, (-self.blocks[self.next]['cost'], self.next))
+                self.next += 1
+            if self.heap:
+                block = heapq.heappop(self.heap)[1]
+        else:
+            share = self.own[thread]
+            if share and share[0] < ready_limit:
+                block = share.popleft()
+            elif self.name == 'stealing' and not share:
+                # the far end of whoever has the most left, or its near end
+                # while the far end hasn't been read yet
+                victim = max(self.own, key=len)
+                if victim and victim[-1] < ready_limit:
+                    block = victim.pop()
+                elif victim and victim[0] < ready_limit:
+                    block = victim.popleft()
+        if block is not None:
+            self.left -= 1
+        return block
+
+
+def simulate(blocks, policy_name, threads, window, nodes, remote_penalty, slowdown):
+    n = len(blocks)
+    window = window or n
+    policy = Policy(policy_name, blocks, threads, nodes)
+    read_start = [None] * n
+    read_end = []  # known reads, in file order - never decreasing
+    compress_end = [None] * n
+    write_end = [None] * n
+    state = {'next_write': 0, 'reader': 0.0, 'writer': 0.0}
+
+    # the reader runs ahead until it is window blocks past the writer, the
+    # writer follows compressed blocks in order - both only move forward
+    # once the times they wait for are known
+    def advance():
+        moved = True
+        while moved:
+            moved = False
+            i = len(read_end)
+            if i < n and (i < window or write_end[i - window] is not None):
+                start = state['reader'] if i < window else max(state['reader'], write_end[i - window])
+                read_start[i] = start
+                read_end.append(start + blocks[i]['read'])
+                state['reader'] = read_end[i]
+                moved = True
+            i = state['next_write']
+            if i < n and compress_end[i] is not None:
+                start = max(state['writer'], compress_end[i])
+                write_end[i] = start + blocks[i]['write']
+                state['writer'] = write_end[i]
+                state['next_write'] += 1
+                moved = True
+
+    # events are threads coming free and reads landing - a thread that
+    # finds nothing ready idles until the next read lands
+    events = [(0.0, 0, t) for t in range(threads)]
+    idle = []
+    landed = [0]
+
+    def schedule_reads():
+        advance()
+        while landed[0] < len(read_end):
+            heapq.heappush(events, (read_end[landed[0]], 1, -1))
+            landed[0] += 1
+
+    def begin(thread, now):
+        i = policy.pick(thread, bisect.bisect_right(read_end, now))
+        if i is None:
+            return False
+        cost = blocks[i]['cost'] * (1 + slowdown * (threads - 1))
+        if policy_name != 'numa' and home_node(i, n, policy.nodes) != policy.node(thread):
+            cost *= 1 + remote_penalty
+        compress_end[i] = now + cost
+        heapq.heappush(events, (compress_end[i], 0, thread))
+        schedule_reads()
+        return True
+
+    schedule_reads()
+    while events or idle:
+        if not events:
+            sys.exit(f'{policy_name}: schedule stalled with {policy.left} blocks left')
+        now, kind, thread = heapq.heappop(events)
+        # a landed read wakes every idle thread
+        woken = [thread] if kind == 0 else idle
+        if kind == 1:
+            idle = []
+        for t in woken:
+            if not policy.has_work(t):
+                continue
+            if not begin(t, now):
+                idle.append(t)
+        if not any(policy.has_work(t) for t in idle):
+            idle = []
+    # peak of input and output bytes held at once
+    changes = []
+    for i in range(n):
+        changes.append((read_start[i], blocks[i]['in']))
+        changes.append((compress_end[i], blocks[i]['out'] - blocks[i]['in']))
+        changes.append((write_end[i], -blocks[i]['out']))
+    held = peak = 0
+    for _, change in sorted(changes):
+        held += change
+        peak = max(peak, held)
+    makespan = max(write_end)
+    busy = sum(b['cost'] for b in blocks)
+    return makespan, peak, busy / (threads * makespan) if makespan else 0.0
+
+
+def int_list(text):
+    return [int(v) for v in text.split(',') if v]
+
+
+parser = argparse.ArgumentParser(description='replay a parallel_bzip2 --trace under other schedules')
+parser.add_argument('trace')
+parser.add_argument('--threads', type=int_list)
+parser.add_argument('--window', type=int_list, default=[0])
+parser.add_argument('--policies', default=','.join(POLICIES))
+parser.add_argument('--nodes', type=int, default=2)
+parser.add_argument('--remote-penalty', type=float, default=0.0)
+parser.add_argument('--slowdown', type=float, default=0.0)
+args = parser.parse_args()
+policies = args.policies.split(',')
+for name in policies:
+    if name not in POLICIES:
+        sys.exit(f'unknown policy {name} ({", ".join(POLICIES)})')
+info, blocks = load_trace(args.trace)
+traced_threads = int(info.get('threads', 1))
+thread_counts = args.threads or sorted({1, traced_threads, 2 * traced_threads, 4 * traced_threads})
+print(f'{len(blocks)} blocks, {sum(b["cost"] for b in blocks):.3f}s of compression, '
+      f'traced with {traced_threads} threads')
+# sanity check - the traced run read everything first and wrote after, so
+# replay only its compression phase
+measured = max(b['end'] for b in blocks)
+compute_only = [dict(b, read=0.0, write=0.0) for b in blocks]
+replayed, _, _ = simulate(compute_only, 'dynamic', traced_threads, 0, 1, 0.0, 0.0)
+print(f'measured compress phase {measured:.3f}s, dynamic replay {replayed:.3f}s')
+print(f"{'policy':<9} {'threads':>7} {'window':>6} {'makespan s':>11} {'peak MB':>8} {'busy %':>7}")
+for name in policies:
+    for threads in thread_counts:
+        for window in args.window:
+            makespan, peak, busy = simulate(blocks, name, threads, window, args.nodes,
+                                            args.remote_penalty, args.slowdown)
+            print(f"{name:<9} {threads:>7} {window or '-':>6} {makespan:>11.3f} "
+                  f"{peak / 1e6:>8.1f} {100 * busy:>7.1f}")
@@ -0,0 +1,23 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+typedef struct {
+    unsigned char *data; // where data is stored
+    unsigned int size; // bytes after compression
+    unsigned int original_size; // bytes before compression
+    unsigned int raw_size; // bytes the codec saw (the long range tokens of a matched block)
+    unsigned int capacity; // bytes mapped for data (0 when it came from malloc)
+    unsigned char codec; // CodecId the data was compressed with
+    unsigned char filter; // FilterId applied before compressing
+    unsigned char filter_param;
+    unsigned int crc; // crc32_bzip2 of the original bytes, for the container
+} CompressedBlock;
+
+// switch block buffers to page aligned mappings that can be handed to a pipe
+void block_set_page_buffers(int enabled);
+// allocate / shrink / free the data buffer of a block
+int block_alloc(CompressedBlock *block, unsigned int size);
+void block_shrink(CompressedBlock *block);
+void block_release(CompressedBlock *block);
+
+#endif
@@ -0,0 +1,796 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "bwt.h"
+#include "container.h"
+#include "huffman.h"
+
+// ---- SA-IS suffix sorting ---- 
+
+// the byte level adds a virtual sentinel after the text and shifts every 
+// byte up by one so the sentinel is the unique smallest symbol 
+typedef struct {
+    const unsigned char *bytes; // level 0
+    const int *ints; // reduced problems
+    int n; // including the sentinel
+} SaisText;
+
+// level is a constant at every call, so each level gets its own copy of the 
+// loops without the test 
+#define SAIS_INLINE static inline __attribute__((always_inline))
+
+SAIS_INLINE int sais_chr(const SaisText *s, int i, int bytes) {
+    if (bytes) {
+        return i == s->n - 1 ? 0 : s->bytes[i] + 1;
+    }
+    return s->ints[i];
+}
+
+#define TYPE_GET(t, i) (((t)[(i) >> 3] >> ((i) & 7)) & 1)
+#define TYPE_SET(t, i, b) ((t)[(i) >> 3] = ((t)[(i) >> 3] & ~(1 << ((i) & 7))) | ((b) << ((i) & 7)))
+// leftmost S type position 
+#define IS_LMS(t, i) ((i) > 0 && TYPE_GET(t, i) && !TYPE_GET(t, (i) - 1))
+
+SAIS_INLINE void sais_buckets(const SaisText *s, int *bucket, int k, int end, int bytes) {
+    memset(bucket, 0, (k + 1) * sizeof(int));
+    for (int i = 0; i < s->n; i++) {
+        bucket[sais_chr(s, i, bytes)]++;
+    }
+    int sum = 0;
+    for (int c = 0; c <= k; c++) {
+        sum += bucket[c];
+        bucket[c] = end ? sum : sum - bucket[c];
+    }
+}
+
+SAIS_INLINE void sais_induce(const SaisText *s, const unsigned char *types, int *sa, 
+                             int *bucket, int k, int bytes) {
+    // L types from the left 
+    sais_buckets(s, bucket, k, 0, bytes);
+    for (int i = 0; i < s->n; i++) {
+        int j = sa[i] - 1;
+        if (j >= 0 && !TYPE_GET(types, j)) {
+            sa[bucket[sais_chr(s, j, bytes)]++] = j;
+        }
+    }
+    // S types from the right 
+    sais_buckets(s, bucket, k, 1, bytes);
+    for (int i = s->n - 1; i >= 0; i--) {
+        int j = sa[i] - 1;
+        if (j >= 0 && TYPE_GET(types, j)) {
+            sa[--bucket[sais_chr(s, j, bytes)]] = j;
+        }
+    }
+}
+
+static int sais(const SaisText *s, int *sa, int k);
+
+// suffix array of s (symbols 0..k, ending in a unique 0) 
+SAIS_INLINE int sais_level(const SaisText *s, int *sa, int k, int bytes) {
+    int n = s->n;
+    unsigned char *types = calloc(n / 8 + 1, 1);
+    int *bucket = malloc((k + 1) * sizeof(int));
+    if (!types || !bucket) {
+        free(types);
+        free(bucket);
+        return -1;
+    }
+    // S = 1, L = 0 - the sentinel is S 
+    TYPE_SET(types, n - 1, 1);
+    if (n >= 2) {
+        TYPE_SET(types, n - 2, 0);
+    }
+    for (int i = n - 3; i >= 0; i--) {
+        int a = sais_chr(s, i, bytes), b = sais_chr(s, i + 1, bytes);
+        TYPE_SET(types, i, (a < b || (a == b && TYPE_GET(types, i + 1))) ? 1 : 0);
+    }
+    // stage 1: sort the LMS substrings 
+    sais_buckets(s, bucket, k, 1, bytes);
+    for (int i = 0; i < n; i++) {
+        sa[i] = -1;
+    }
+    for (int i = 1; i < n; i++) {
+        if (IS_LMS(types, i)) {
+            sa[--bucket[sais_chr(s, i, bytes)]] = i;
+        }
+    }
+    sais_induce(s, types, sa, bucket, k, bytes);
+    // compact the sorted LMS substrings and name them 
+    int n1 = 0;
+    for (int i = 0; i < n; i++) {
+        if (IS_LMS(types, sa[i])) {
+            sa[n1++] = sa[i];
+        }
+    }
+    for (int i = n1; i < n; i++) {
+        sa[i] = -1;
+    }
+    int name = 0;
+    int prev = -1;
+    for (int i = 0; i < n1; i++) {
+        int pos = sa[i];
+        int diff = 0;
+        for (int d = 0; d < n; d++) {
+            if (prev == -1 || sais_chr(s, pos + d, bytes) != sais_chr(s, prev + d, bytes) || 
+                TYPE_GET(types, pos + d) != TYPE_GET(types, prev + d)) {
+                diff = 1;
+                break;
+            }
+            if (d > 0 && (IS_LMS(types, pos + d) || IS_LMS(types, prev + d))) {
+                break;
+            }
+        }
+        if (diff) {
+            name++;
+            prev = pos;
+        }
+        sa[n1 + pos / 2] = name - 1;
+    }
+    for (int i = n - 1, j = n - 1; i >= n1; i--) {
+        if (sa[i] >= 0) {
+            sa[j--] = sa[i];
+        }
+    }
+    // stage 2: sort the reduced string, recursing while names repeat 
+    int *sa1 = sa;
+    int *s1 = sa + n - n1;
+    if (name < n1) {
+        SaisText reduced = {NULL, s1, n1};
+        if (sais(&reduced, sa1, name - 1) != 0) {
+            free(types);
+            free(bucket);
+            return -1;
+        }
+    } else {
+        for (int i = 0; i < n1; i++) {
+            sa1[s1[i]] = i;
+        }
+    }
+    // stage 3: induce the full order from the sorted LMS suffixes 
+    sais_buckets(s, bucket, k, 1, bytes);
+    for (int i = 1, j = 0; i < n; i++) {
+        if (IS_LMS(types, i)) {
+            s1[j++] = i;
+        }
+    }
+    for (int i = 0; i < n1; i++) {
+        sa1[i] = s1[sa1[i]];
+    }
+    for (int i = n1; i < n; i++) {
+        sa[i] = -1;
+    }
+    for (int i = n1 - 1; i >= 0; i--) {
+        int j = sa[i];
+        sa[i] = -1;
+        sa[--bucket[sais_chr(s, j, bytes)]] = j;
+    }
+    sais_induce(s, types, sa, bucket, k, bytes);
+    free(types);
+    free(bucket);
+    return 0;
+}
+
+static int sais(const SaisText *s, int *sa, int k) {
+    return s->bytes ? sais_level(s, sa, k, 1) : sais_level(s, sa, k, 0);
+}
+
+// where the inverse walks start: the rows of the suffixes at 0 (the 
+// primary), and for more than one walk at every multiple of size / walks 
+typedef struct {
+    unsigned int primary;
+    int walks;
+    unsigned int rows[BWT_MAX_WALKS]; // rows[k] begins the walk ending at segment k + 1
+} BwtIndex;
+
+// last column of the sorted rotations of text + sentinel, without the 
+// sentinel - its row is the primary index 
+static int bwt_forward(const unsigned char *in, unsigned int size, unsigned char *out, 
+                       BwtIndex *index) {
+    int *sa = malloc(((size_t)size + 1) * sizeof(int));
+    if (!sa) {
+        return -1;
+    }
+    SaisText text = {in, NULL, (int)size + 1};
+    if (sais(&text, sa, 256) != 0) {
+        free(sa);
+        return -1;
+    }
+    unsigned int segment = size / index->walks;
+    unsigned int k = 0;
+    for (unsigned int i = 0; i <= size; i++) {
+        unsigned int suffix = sa[i];
+        if (suffix == 0) {
+            index->primary = i;
+            continue;
+        }
+        out[k++] = in[suffix - 1];
+        if (index->walks > 1 && suffix % segment == 0 && 
+            suffix / segment < (unsigned int)index->walks) {
+            index->rows[suffix / segment - 1] = i;
+        }
+    }
+    free(sa);
+    return 0;
+}
+
+static int bwt_inverse(const unsigned char *last, unsigned int size, const BwtIndex *index, 
+                       unsigned char *out) {
+    unsigned int primary = index->primary;
+    if (primary == 0 || primary > size) {
+        return -1;
+    }
+    int walks = index->walks;
+    for (int k = 0; k + 1 < walks; k++) {
+        if (index->rows[k] > size) {
+            return -1;
+        }
+    }
+    uint32_t *lf = malloc(((size_t)size + 1) * sizeof(uint32_t));
+    if (!lf) {
+        return -1;
+    }
+    // row 0 starts with the sentinel, so every byte's rows start one later 
+    unsigned int start[256];
+    unsigned int count[256] = {0};
+    for (unsigned int i = 0; i < size; i++) {
+        count[last[i]]++;
+    }
+    for (unsigned int c = 0, sum = 1; c < 256; c++) {
+        start[c] = sum;
+        sum += count[c];
+    }
+    // row r holds last[r], or last[r - 1] past the sentinel's row. blocks 
+    // under 16M keep the byte next to its successor row, so each step of 
+    // the walk is a single cache miss 
+    int packed = size < (1U << 24);
+    for (unsigned int r = 0; r <= size; r++) {
+        if (r == primary) {
+            lf[r] = 0;
+            continue;
+        }
+        unsigned char c = last[r - (r > primary)];
+        lf[r] = packed ? start[c]++ << 8 | c : start[c]++;
+    }
+    // each walk goes backwards through one segment, the last one from the 
+    // row that ends the text. the walks don't depend on each other, so 
+    // stepping them in turn keeps one cache miss per walk in flight 
+    unsigned int segment = size / walks;
+    unsigned int row[BWT_MAX_WALKS];
+    unsigned int at[BWT_MAX_WALKS];
+    for (int k = 0; k < walks; k++) {
+        row[k] = k + 1 < walks ? index->rows[k] : 0;
+        at[k] = k + 1 < walks ? (k + 1) * segment : size;
+    }
+    if (packed) {
+        uint32_t entry[BWT_MAX_WALKS];
+        for (int k = 0; k < walks; k++) {
+            entry[k] = lf[row[k]];
+        }
+        // the last segment has the remainder of size / walks on top 
+        for (unsigned int i = size - walks * segment; i > 0; i--) {
+            out[--at[walks - 1]] = entry[walks - 1] & 0xFF;
+            entry[walks - 1] = lf[entry[walks - 1] >> 8];
+        }
+        for (unsigned int i = 0; i < segment; i++) {
+            for (int k = 0; k < walks; k++) {
+                out[--at[k]] = entry[k] & 0xFF;
+                entry[k] = lf[entry[k] >> 8];
+                __builtin_prefetch(&lf[entry[k] >> 8]);
+            }
+        }
+    } else {
+        for (unsigned int i = size - walks * segment; i > 0; i--) {
+            unsigned int r = row[walks - 1];
+            out[--at[walks - 1]] = last[r - (r > primary)];
+            row[walks - 1] = lf[r];
+        }
+        for (unsigned int i = 0; i < segment; i++) {
+            for (int k = 0; k < walks; k++) {
+                unsigned int r = row[k];
+                out[--at[k]] = last[r - (r > primary)];
+                row[k] = lf[r];
+                __builtin_prefetch(&lf[row[k]]);
+            }
+        }
+    }
+    free(lf);
+    return 0;
+}
+
+// ---- adaptive binary range coder ---- 
+
+#define PROB_BITS 12
+#define PROB_INIT (1 << (PROB_BITS - 1))
+#define PROB_SHIFT 5
+#define RANGE_TOP (1U << 24)
+
+typedef struct {
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint64_t cache_size;
+    unsigned char *out;
+    unsigned char *end;
+    int overflow;
+} RangeEncoder;
+
+static void rc_init(RangeEncoder *rc, unsigned char *out, unsigned char *end) {
+    rc->low = 0;
+    rc->range = 0xFFFFFFFF;
+    rc->cache = 0;
+    rc->cache_size = 1;
+    rc->out = out;
+    rc->end = end;
+    rc->overflow = 0;
+}
+
+static inline void rc_put(RangeEncoder *rc, unsigned char byte) {
+    if (rc->out == rc->end) {
+        rc->overflow = 1;
+        return;
+    }
+    *rc->out++ = byte;
+}
+
+static inline void rc_shift_low(RangeEncoder *rc) {
+    if ((uint32_t)rc->low < 0xFF000000U || (rc->low >> 32) != 0) {
+        uint8_t carry = rc->low >> 32;
+        uint8_t byte = rc->cache;
+        do {
+            rc_put(rc, byte + carry);
+            byte = 0xFF;
+        } while (--rc->cache_size != 0);
+        rc->cache = (rc->low >> 24) & 0xFF;
+    }
+    rc->cache_size++;
+    rc->low = (rc->low & 0x00FFFFFF) << 8;
+}
+
+static inline void rc_bit(RangeEncoder *rc, uint16_t *prob, int bit) {
+    uint32_t bound = (rc->range >> PROB_BITS) * *prob;
+    if (!bit) {
+        rc->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_SHIFT;
+    } else {
+        rc->low += bound;
+        rc->range -= bound;
+        *prob -= *prob >> PROB_SHIFT;
+    }
+    while (rc->range < RANGE_TOP) {
+        rc->range <<= 8;
+        rc_shift_low(rc);
+    }
+}
+
+static void rc_flush(RangeEncoder *rc) {
+    for (int i = 0; i < 5; i++) {
+        rc_shift_low(rc);
+    }
+}
+
+typedef struct {
+    uint32_t range;
+    uint32_t code;
+    const unsigned char *in;
+    const unsigned char *end;
+} RangeDecoder;
+
+static inline unsigned char rd_byte(RangeDecoder *rd) {
+    // reading past the end yields zeros - the size checks catch bad input 
+    return rd->in < rd->end ? *rd->in++ : 0;
+}
+
+static void rd_init(RangeDecoder *rd, const unsigned char *in, const unsigned char *end) {
+    rd->in = in;
+    rd->end = end;
+    rd->range = 0xFFFFFFFF;
+    rd->code = 0;
+    for (int i = 0; i < 5; i++) {
+        rd->code = (rd->code << 8) | rd_byte(rd);
+    }
+}
+
+static inline int rd_bit(RangeDecoder *rd, uint16_t *prob) {
+    uint32_t bound = (rd->range >> PROB_BITS) * *prob;
+    int bit;
+    if (rd->code < bound) {
+        rd->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_SHIFT;
+        bit = 0;
+    } else {
+        rd->code -= bound;
+        rd->range -= bound;
+        *prob -= *prob >> PROB_SHIFT;
+        bit = 1;
+    }
+    while (rd->range < RANGE_TOP) {
+        rd->range <<= 8;
+        rd->code = (rd->code << 8) | rd_byte(rd);
+    }
+    return bit;
+}
+
+// ---- symbol model ---- 
+// the MTF output is a run of zeros (length coded Elias gamma style) or a 
+// rank 1..255 (coded as its bit length, then the bits below the top one). 
+// contexts are the bit length of the previous rank 
+
+typedef struct {
+    uint16_t is_run[9];
+    uint16_t run_length[32];
+    uint16_t run_bits[32][32];
+    uint16_t rank_length[9][8];
+    uint16_t rank_bits[8][128];
+} SymbolModel;
+
+static void model_init(SymbolModel *model) {
+    uint16_t *p = (uint16_t *)model;
+    for (size_t i = 0; i < sizeof(*model) / sizeof(uint16_t); i++) {
+        p[i] = PROB_INIT;
+    }
+}
+
+static inline int bit_length(unsigned int value) {
+    return 31 - __builtin_clz(value);
+}
+
+static void encode_run(RangeEncoder *rc, SymbolModel *m, unsigned int length) {
+    int bits = bit_length(length);
+    for (int i = 0; i < bits; i++) {
+        rc_bit(rc, &m->run_length[i], 1);
+    }
+    if (bits < 31) {
+        rc_bit(rc, &m->run_length[bits], 0);
+    }
+    for (int i = bits - 1; i >= 0; i--) {
+        rc_bit(rc, &m->run_bits[bits][i], (length >> i) & 1);
+    }
+}
+
+static unsigned int decode_run(RangeDecoder *rd, SymbolModel *m) {
+    int bits = 0;
+    while (bits < 31 && rd_bit(rd, &m->run_length[bits])) {
+        bits++;
+    }
+    unsigned int length = 1;
+    for (int i = bits - 1; i >= 0; i--) {
+        length = (length << 1) | rd_bit(rd, &m->run_bits[bits][i]);
+    }
+    return length;
+}
+
+static void encode_rank(RangeEncoder *rc, SymbolModel *m, int context, unsigned int rank) {
+    int bits = bit_length(rank);
+    // 3 bit tree for the length 
+    for (int i = 2, node = 1; i >= 0; i--) {
+        int bit = (bits >> i) & 1;
+        rc_bit(rc, &m->rank_length[context][node], bit);
+        node = (node << 1) | bit;
+    }
+    for (int i = bits - 1, node = 1; i >= 0; i--) {
+        int bit = (rank >> i) & 1;
+        rc_bit(rc, &m->rank_bits[bits][node], bit);
+        node = (node << 1) | bit;
+    }
+}
+
+static unsigned int decode_rank(RangeDecoder *rd, SymbolModel *m, int context) {
+    int node = 1;
+    for (int i = 0; i < 3; i++) {
+        node = (node << 1) | rd_bit(rd, &m->rank_length[context][node]);
+    }
+    int bits = node - 8;
+    unsigned int rank = 1;
+    node = 1;
+    for (int i = 0; i < bits; i++) {
+        int bit = rd_bit(rd, &m->rank_bits[bits][node]);
+        node = (node << 1) | bit;
+        rank = (rank << 1) | bit;
+    }
+    return rank;
+}
+
+unsigned int bwt_bound(unsigned int size) {
+    return size + 5;
+}
+
+static int store(const unsigned char *in, unsigned int size, unsigned char *out, 
+                 unsigned int *out_size) {
+    out[0] = BWT_STORED;
+    memcpy(out + 1, in, size);
+    *out_size = size + 1;
+    return 0;
+}
+
+double byte_entropy(const unsigned char *in, unsigned int size) {
+    unsigned int count[256] = {0};
+    for (unsigned int i = 0; i < size; i++) {
+        count[in[i]]++;
+    }
+    double bits = 0;
+    for (int c = 0; c < 256; c++) {
+        if (count[c]) {
+            double p = (double)count[c] / size;
+            bits -= p * log2(p);
+        }
+    }
+    return bits;
+}
+
+// range coded ranks and runs - the payload size, or -1 past capacity 
+static long range_code(const unsigned char *last, unsigned int size, unsigned char *out, 
+                       unsigned int capacity) {
+    SymbolModel *model = malloc(sizeof(SymbolModel));
+    if (!model) {
+        return -1;
+    }
+    model_init(model);
+    RangeEncoder rc;
+    rc_init(&rc, out, out + capacity);
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = i;
+    }
+    int context = 0;
+    unsigned int run = 0;
+    for (unsigned int i = 0; i < size && !rc.overflow; i++) {
+        unsigned char c = last[i];
+        if (order[0] == c) {
+            run++;
+            continue;
+        }
+        if (run) {
+            rc_bit(&rc, &model->is_run[context], 1);
+            encode_run(&rc, model, run);
+            run = 0;
+            context = 8;
+        }
+        unsigned int rank = 1;
+        while (order[rank] != c) {
+            rank++;
+        }
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        if (context != 8) {
+            rc_bit(&rc, &model->is_run[context], 0);
+        }
+        encode_rank(&rc, model, context, rank);
+        context = bit_length(rank);
+    }
+    if (run) {
+        rc_bit(&rc, &model->is_run[context], 1);
+        encode_run(&rc, model, run);
+    }
+    rc_flush(&rc);
+    free(model);
+    return rc.overflow ? -1 : rc.out - out;
+}
+
+// a zero run as bijective base 2 digits, least significant first 
+static unsigned int put_run(uint16_t *symbols, unsigned int n, unsigned int run) {
+    run--;
+    for (;;) {
+        symbols[n++] = run & 1 ? HUFF_RUNB : HUFF_RUNA;
+        if (run < 2) {
+            return n;
+        }
+        run = (run - 2) / 2;
+    }
+}
+
+// bzip2's symbols for the huffman stage 
+static unsigned int mtf_symbols(const unsigned char *last, unsigned int size, 
+                                uint16_t *symbols) {
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = i;
+    }
+    unsigned int n = 0;
+    unsigned int run = 0;
+    for (unsigned int i = 0; i < size; i++) {
+        unsigned char c = last[i];
+        if (order[0] == c) {
+            run++;
+            continue;
+        }
+        if (run) {
+            n = put_run(symbols, n, run);
+            run = 0;
+        }
+        unsigned int rank = 1;
+        while (order[rank] != c) {
+            rank++;
+        }
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        symbols[n++] = rank + 1;
+    }
+    if (run) {
+        n = put_run(symbols, n, run);
+    }
+    return n;
+}
+
+// and back 
+static int mtf_expand(const uint16_t *symbols, unsigned int count, unsigned char *last, 
+                      unsigned int size) {
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = i;
+    }
+    unsigned int at = 0;
+    unsigned int run = 0;
+    unsigned int weight = 1;
+    for (unsigned int i = 0; i <= count; i++) {
+        if (i < count && symbols[i] <= HUFF_RUNB) {
+            run += weight << symbols[i];
+            weight <<= 1;
+            if (run > size) {
+                return -1;
+            }
+            continue;
+        }
+        if (run) {
+            if (run > size - at) {
+                return -1;
+            }
+            memset(last + at, order[0], run);
+            at += run;
+            run = 0;
+            weight = 1;
+        }
+        if (i == count) {
+            break;
+        }
+        unsigned int rank = symbols[i] - 1;
+        if (rank > 255 || at == size) {
+            return -1;
+        }
+        unsigned char c = order[rank];
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        last[at++] = c;
+    }
+    return at == size ? 0 : -1;
+}
+
+int bwt_encode(const unsigned char *in, unsigned int size, unsigned char *out, 
+               unsigned int *out_size, int mode, int fast) {
+    // tiny blocks, and blocks whose bytes are already near uniform (packed 
+    // or encrypted data), are stored without paying for the sort 
+    if (size < 16 || (size >= 4096 && byte_entropy(in, size) > 7.99)) {
+        return store(in, size, out, out_size);
+    }
+    unsigned char *last = malloc(size);
+    uint16_t *symbols = mode == BWT_HUFFMAN ? malloc((size_t)size * sizeof(uint16_t)) : NULL;
+    BwtIndex index = {0, size >= BWT_WALK_MIN ? BWT_MAX_WALKS : 1, {0}};
+    if (!last || (mode == BWT_HUFFMAN && !symbols) || 
+        bwt_forward(in, size, last, &index) != 0) {
+        free(last);
+        free(symbols);
+        return -1;
+    }
+    unsigned int header = 5;
+    out[0] = mode;
+    put_u32(out + 1, index.primary);
+    if (index.walks > 1) {
+        out[0] |= BWT_WALKS;
+        out[header++] = index.walks - 1;
+        for (int k = 0; k + 1 < index.walks; k++) {
+            put_u32(out + header, index.rows[k]);
+            header += 4;
+        }
+    }
+    // anything that doesn't beat storing the block gets stored 
+    long payload;
+    if (mode == BWT_HUFFMAN) {
+        unsigned int count = mtf_symbols(last, size, symbols);
+        payload = huffman_encode(symbols, count, out + header, size + 1 - header, fast);
+    } else {
+        payload = range_code(last, size, out + header, size + 1 - header);
+    }
+    free(last);
+    free(symbols);
+    if (payload < 0) {
+        return store(in, size, out, out_size);
+    }
+    *out_size = header + payload;
+    return 0;
+}
+
+int bwt_decode(const unsigned char *in, unsigned int in_size, unsigned char *out, 
+               unsigned int out_size) {
+    if (in_size < 1) {
+        return -1;
+    }
+    if (in[0] == BWT_STORED) {
+        if (in_size != out_size + 1) {
+            return -1;
+        }
+        memcpy(out, in + 1, out_size);
+        return 0;
+    }
+    int mode = in[0] & ~BWT_WALKS;
+    if ((mode != BWT_CODED && mode != BWT_HUFFMAN) || in_size < 5) {
+        return -1;
+    }
+    BwtIndex index = {get_u32(in + 1), 1, {0}};
+    unsigned int header = 5;
+    if (in[0] & BWT_WALKS) {
+        if (in_size < 6 || in[5] == 0 || in[5] >= BWT_MAX_WALKS || 
+            in_size < 6 + 4 * (unsigned int)in[5]) {
+            return -1;
+        }
+        index.walks = in[5] + 1;
+        header = 6;
+        for (int k = 0; k + 1 < index.walks; k++) {
+            index.rows[k] = get_u32(in + header);
+            header += 4;
+        }
+        // every segment needs at least one byte 
+        if (out_size < (unsigned int)index.walks) {
+            return -1;
+        }
+    }
+    in += header;
+    in_size -= header;
+    if (mode == BWT_HUFFMAN) {
+        unsigned char *last = malloc(out_size ? out_size : 1);
+        uint16_t *symbols = malloc(((size_t)out_size + 1) * sizeof(uint16_t));
+        long count = last && symbols ? 
+                     huffman_decode(in, in_size, symbols, out_size + 1) : -1;
+        int result = count >= 0 && mtf_expand(symbols, count, last, out_size) == 0 ? 
+                     bwt_inverse(last, out_size, &index, out) : -1;
+        free(last);
+        free(symbols);
+        return result;
+    }
+    unsigned char *last = malloc(out_size ? out_size : 1);
+    SymbolModel *model = malloc(sizeof(SymbolModel));
+    if (!last || !model) {
+        free(last);
+        free(model);
+        return -1;
+    }
+    model_init(model);
+    RangeDecoder rd;
+    rd_init(&rd, in, in + in_size);
+    unsigned char order[256];
+    for (int i = 0; i < 256; i++) {
+        order[i] = i;
+    }
+    int context = 0;
+    int result = 0;
+    for (unsigned int i = 0; i < out_size;) {
+        // after a run there is always a rank 
+        if (context != 8 && rd_bit(&rd, &model->is_run[context])) {
+            unsigned int run = decode_run(&rd, model);
+            if (run > out_size - i) {
+                result = -1;
+                break;
+            }
+            memset(last + i, order[0], run);
+            i += run;
+            context = 8;
+            continue;
+        }
+        unsigned int rank = decode_rank(&rd, model, context);
+        if (rank > 255) {
+            result = -1;
+            break;
+        }
+        unsigned char c = order[rank];
+        memmove(order + 1, order, rank);
+        order[0] = c;
+        last[i++] = c;
+        context = bit_length(rank);
+    }
+    if (result == 0) {
+        result = bwt_inverse(last, out_size, &index, out);
+    }
+    free(last);
+    free(model);
+    return result;
+}
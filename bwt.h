@@ -0,0 +1,33 @@
+#ifndef BWT_H
+#define BWT_H
+
+// in-house BWT codec: SA-IS suffix sort and move-to-front with zero runs, 
+// then either an adaptive binary range coder (--codec bwt-fast) or bzip2 
+// style huffman tables (--codec bwt-huff, see huffman.h). a block is 
+//   u8 mode [u32 primary index, (BWT_WALKS) u8 n, n u32 rows, coded symbols] 
+// and decodes on its own given its original size. blocks are not limited 
+// to bzip2's 900k, but the sort misses cache once a block outgrows L2 
+// (the inverse walks overlap most of theirs), so -b trades speed for a 
+// little ratio 
+#define BWT_STORED 0
+#define BWT_CODED 1 // range coder
+#define BWT_HUFFMAN 2
+// mode flag: the rows where the suffixes at every multiple of size / (n + 1) 
+// sort follow the primary index, so the inverse can walk n + 1 segments at 
+// once instead of one long chain of cache misses 
+#define BWT_WALKS 0x80
+#define BWT_MAX_WALKS 8
+// blocks smaller than this fit in cache and are walked in one go 
+#define BWT_WALK_MIN (64 * 1024)
+
+// largest output bwt_encode can produce for size input bytes 
+unsigned int bwt_bound(unsigned int size);
+// mode is BWT_CODED or BWT_HUFFMAN - fast only matters to the huffman stage 
+int bwt_encode(const unsigned char *in, unsigned int size, unsigned char *out, 
+               unsigned int *out_size, int mode, int fast);
+int bwt_decode(const unsigned char *in, unsigned int in_size, unsigned char *out, 
+               unsigned int out_size);
+// order 0 entropy in bits per byte - 8 means nothing to gain from coding 
+double byte_entropy(const unsigned char *in, unsigned int size);
+
+#endif
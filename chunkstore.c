@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "chunkstore.h"
+#include "output.h"
+
+void chunk_name(const unsigned char *data, unsigned int size, char name[CHUNK_NAME_SIZE]) {
+    sha256_hex(data, size, name);
+}
+
+char *chunk_path(const char *store, const char *name) {
+    // fan out over 256 subdirectories so no directory gets huge 
+    char *path = malloc(strlen(store) + strlen(name) + 16);
+    if (path) {
+        sprintf(path, "%s/%.2s/%s.bz2", store, name, name);
+    }
+    return path;
+}
+
+int chunk_exists(const char *store, const char *name) {
+    char *path = chunk_path(store, name);
+    if (!path) {
+        return 0;
+    }
+    struct stat st;
+    int exists = stat(path, &st) == 0 && S_ISREG(st.st_mode);
+    free(path);
+    return exists;
+}
+
+static int make_dir(const char *path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        perror(path);
+        return -1;
+    }
+    return 0;
+}
+
+int chunk_put(const char *store, const char *name, const CompressedBlock *block, int durable) {
+    char *path = chunk_path(store, name);
+    if (!path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    // make sure store/xx exists 
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    int result = make_dir(store) == 0 ? make_dir(path) : -1;
+    *slash = '/';
+    // two workers may race on the same chunk, so each writes a private 
+    // temp name and renames it - a half written chunk never shows up under 
+    // its real name 
+    static int temp_counter = 0;
+    char *temp = malloc(strlen(path) + 48);
+    if (!temp) {
+        result = -1;
+    } else {
+        sprintf(temp, "%s.%ld.%d.tmp", path, (long)getpid(), 
+                __atomic_fetch_add(&temp_counter, 1, __ATOMIC_RELAXED));
+    }
+    OutputSink sink;
+    if (result == 0) {
+        if (sink_open(&sink, temp, 0) != 0) {
+            result = -1;
+        } else if (sink_write_block(&sink, block) != 0 || 
+                   (durable && fdatasync(sink.fd) != 0)) {
+            perror(temp);
+            sink_abort(&sink);
+            unlink(temp);
+            result = -1;
+        } else if (sink_close(&sink) != 0) {
+            result = -1;
+        }
+    }
+    if (result == 0 && rename(temp, path) != 0) {
+        perror(path);
+        unlink(temp);
+        result = -1;
+    }
+    if (result == 0 && durable && sync_parent_dir(path) != 0) {
+        perror(path);
+        result = -1;
+    }
+    free(temp);
+    free(path);
+    return result;
+}
+
+int chunk_restore(const char *store, const char *recipe_path, const char *output_filename) {
+    FILE *recipe = fopen(recipe_path, "r");
+    if (!recipe) {
+        perror(recipe_path);
+        return -1;
+    }
+    OutputSink output;
+    if (sink_open(&output, output_filename, 0) != 0) {
+        fclose(recipe);
+        return -1;
+    }
+    int result = 0;
+    unsigned char *buffer = NULL;
+    char line[256];
+    char name[CHUNK_NAME_SIZE];
+    unsigned int original_size;
+    while (result == 0 && fgets(line, sizeof(line), recipe)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "%64s\t%u", name, &original_size) != 2 || 
+            strlen(name) != CHUNK_NAME_SIZE - 1) {
+            fprintf(stderr, "Bad recipe line: %s", line);
+            result = -1;
+            break;
+        }
+        // chunks are whole bzip2 streams, so they just get concatenated 
+        char *path = chunk_path(store, name);
+        FILE *chunk = path ? fopen(path, "rb") : NULL;
+        if (!chunk) {
+            perror(path ? path : name);
+            free(path);
+            result = -1;
+            break;
+        }
+        struct stat st;
+        if (fstat(fileno(chunk), &st) != 0) {
+            perror(path);
+            fclose(chunk);
+            free(path);
+            result = -1;
+            break;
+        }
+        unsigned char *grown = realloc(buffer, st.st_size ? st.st_size : 1);
+        if (grown) {
+            buffer = grown;
+        }
+        if (!grown || fread(buffer, 1, st.st_size, chunk) != (size_t)st.st_size) {
+            fprintf(stderr, "Error reading chunk %s\n", path);
+            result = -1;
+        }
+        if (result == 0 && sink_write(&output, buffer, st.st_size) != 0) {
+            perror(output_filename);
+            result = -1;
+        }
+        fclose(chunk);
+        free(path);
+    }
+    fclose(recipe);
+    free(buffer);
+    if (result == 0) {
+        result = sink_close(&output);
+    } else {
+        sink_abort(&output);
+    }
+    return result;
+}
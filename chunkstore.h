@@ -0,0 +1,21 @@
+#ifndef CHUNKSTORE_H
+#define CHUNKSTORE_H
+
+#include "block.h"
+#include "sha256.h"
+
+// a chunk is named by the hash of its uncompressed bytes
+#define CHUNK_NAME_SIZE (2 * SHA256_DIGEST_SIZE + 1)
+
+// hash a block's uncompressed bytes
+void chunk_name(const unsigned char *data, unsigned int size, char name[CHUNK_NAME_SIZE]);
+// store/xx/<name>.bz2 - caller frees
+char *chunk_path(const char *store, const char *name);
+// is the chunk already in the store
+int chunk_exists(const char *store, const char *name);
+// write a compressed block into the store under its name
+int chunk_put(const char *store, const char *name, const CompressedBlock *block, int durable);
+// concatenate the chunks a recipe lists into one archive
+int chunk_restore(const char *store, const char *recipe_path, const char *output_filename);
+
+#endif
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <bzlib.h>
+#include <zlib.h>
+#include "bwt.h"
+#include "codec.h"
+#include "huffman.h"
+
+static const struct {
+    const char *name;
+    CodecId codec;
+    int default_level;
+} codecs[] = {
+    {"bz2", CODEC_BZIP2, 9},
+    {"gz", CODEC_GZIP, 6},
+    // level is accepted for symmetry but nothing in it is tunable yet 
+    {"bwt-fast", CODEC_BWT, 1},
+    // levels up to 5 reuse the huffman tables of the block this thread 
+    // coded before, so their output depends on thread count and scheduling 
+    {"bwt-huff", CODEC_BWT_HUFF, 9},
+};
+#define NUM_CODECS (int)(sizeof(codecs) / sizeof(codecs[0]))
+
+const char *codec_name(CodecId codec) {
+    for (int i = 0; i < NUM_CODECS; i++) {
+        if (codecs[i].codec == codec) {
+            return codecs[i].name;
+        }
+    }
+    return "?";
+}
+
+int parse_encoder(const char *spec, EncoderConfig *config, const char **rest) {
+    size_t name_len = strcspn(spec, ":");
+    int found = -1;
+    for (int i = 0; i < NUM_CODECS; i++) {
+        if (strlen(codecs[i].name) == name_len && 
+            strncmp(spec, codecs[i].name, name_len) == 0) {
+            found = i;
+        }
+    }
+    if (found < 0) {
+        fprintf(stderr, "Unknown codec in '%s'\n", spec);
+        return -1;
+    }
+    config->codec = codecs[found].codec;
+    config->level = codecs[found].default_level;
+    const char *p = spec + name_len;
+    // optional level - only if the next field is all digits 
+    if (*p == ':' && isdigit((unsigned char)p[1])) {
+        size_t digits = strspn(p + 1, "0123456789");
+        if (p[1 + digits] == ':' || p[1 + digits] == '\0') {
+            config->level = atoi(p + 1);
+            p += 1 + digits;
+        }
+    }
+    if (config->level < 1 || config->level > 9) {
+        fprintf(stderr, "Level must be 1-9 in '%s'\n", spec);
+        return -1;
+    }
+    if (*p == ':') {
+        p++;
+    }
+    if (rest) {
+        *rest = *p ? p : NULL;
+    } else if (*p) {
+        fprintf(stderr, "Unexpected '%s' in codec '%s'\n", p, spec);
+        return -1;
+    }
+    return 0;
+}
+
+// deflate stream with the dictionary already loaded - one per thread, so 
+// each block starts from a copy instead of hashing the dictionary again 
+static __thread z_stream *primed_stream;
+static __thread const Dictionary *primed_dict;
+static __thread int primed_level;
+
+static z_stream *primed_for(const Dictionary *dict, int level) {
+    if (primed_stream && primed_dict == dict && primed_level == level) {
+        return primed_stream;
+    }
+    if (primed_stream) {
+        deflateEnd(primed_stream);
+        free(primed_stream);
+    }
+    primed_stream = calloc(1, sizeof(z_stream));
+    if (!primed_stream) {
+        return NULL;
+    }
+    if (deflateInit2(primed_stream, level, Z_DEFLATED, 15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        free(primed_stream);
+        primed_stream = NULL;
+        return NULL;
+    }
+    if (deflateSetDictionary(primed_stream, dict->data, dict->size) != Z_OK) {
+        deflateEnd(primed_stream);
+        free(primed_stream);
+        primed_stream = NULL;
+        return NULL;
+    }
+    primed_dict = dict;
+    primed_level = level;
+    return primed_stream;
+}
+
+// one gzip member per block - members concatenate into a valid .gz; inside 
+// our container it is a zlib stream, optionally against a dictionary 
+static int compress_block_gzip(unsigned char *input, unsigned int input_size, 
+                               CompressedBlock *output, const EncoderConfig *config) {
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int result;
+    if (config->dict) {
+        z_stream *primed = primed_for(config->dict, config->level);
+        result = primed ? deflateCopy(&strm, primed) : Z_MEM_ERROR;
+    } else {
+        // window bits 15 + 16 asks zlib for a gzip header
+        result = deflateInit2(&strm, config->level, Z_DEFLATED, 
+                              config->container ? 15 : 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    }
+    if (result != Z_OK) {
+        fprintf(stderr, "deflate setup failed with error %d\n", result);
+        return -1;
+    }
+    unsigned int output_buffer_size = deflateBound(&strm, input_size);
+    if (block_alloc(output, output_buffer_size) != 0) {
+        fprintf(stderr, "Memory allocation failed in compress_block\n");
+        deflateEnd(&strm);
+        return -1;
+    }
+    output->original_size = output->raw_size = input_size;
+    output->codec = CODEC_GZIP;
+    strm.next_in = input;
+    strm.avail_in = input_size;
+    strm.next_out = output->data;
+    strm.avail_out = output_buffer_size;
+    // the bound guarantees a single call finishes 
+    result = deflate(&strm, Z_FINISH);
+    output->size = output_buffer_size - strm.avail_out;
+    deflateEnd(&strm);
+    if (result != Z_STREAM_END) {
+        fprintf(stderr, "deflate failed with error %d\n", result);
+        block_release(output);
+        return -1;
+    }
+    block_shrink(output);
+    return 0;
+}
+
+static int compress_block_bwt(unsigned char *input, unsigned int input_size, 
+                              CompressedBlock *output, const EncoderConfig *config) {
+    if (block_alloc(output, bwt_bound(input_size)) != 0) {
+        fprintf(stderr, "Memory allocation failed in compress_block\n");
+        return -1;
+    }
+    output->original_size = output->raw_size = input_size;
+    output->codec = config->codec;
+    int huffman = config->codec == CODEC_BWT_HUFF;
+    if (bwt_encode(input, input_size, output->data, &output->size, 
+                   huffman ? BWT_HUFFMAN : BWT_CODED, huffman && config->level <= 5) != 0) {
+        fprintf(stderr, "bwt encoding failed\n");
+        block_release(output);
+        return -1;
+    }
+    block_shrink(output);
+    return 0;
+}
+
+// actual compression 
+int compress_block(unsigned char *input, unsigned int input_size, 
+                   CompressedBlock *output, const EncoderConfig *config) {
+    if (config->codec == CODEC_GZIP) {
+        return compress_block_gzip(input, input_size, output, config);
+    }
+    if (config->codec == CODEC_BWT || config->codec == CODEC_BWT_HUFF) {
+        return compress_block_bwt(input, input_size, output, config);
+    }
+    // allocate output buffer a little bigger in case of expansion              
+    unsigned int output_buffer_size = input_size + (input_size / 100) + 600;
+    // allocate the buffer 
+    // check if we ran out of memory 
+    if (block_alloc(output, output_buffer_size) != 0) {
+        fprintf(stderr, "Memory allocation failed in compress_block\n");
+        return -1;
+    }
+    // fill in the struct fields 
+    output->size = output_buffer_size;
+    output->original_size = output->raw_size = input_size;
+    output->codec = CODEC_BZIP2;
+    // call bzip2 library for compression - level is the 100k block size
+    int result = BZ2_bzBuffToBuffCompress(
+        (char *)output->data,
+        &output->size,
+        (char *)input,
+        input_size,
+        config->level,  
+        0,  
+        30  
+    );
+    // check if compression failed, if so free buffer 
+    if (result != BZ_OK) {
+        fprintf(stderr, "BZ2_bzBuffToBuffCompress failed with error %d\n", result);
+        block_release(output);
+        return -1;
+    }
+    // shrink the buffer to actual size 
+    block_shrink(output);
+
+    return 0;
+}
+
+// inflate stream reused by every block a thread decodes 
+static __thread z_stream *inflate_stream;
+
+int decompress_block(const unsigned char *input, unsigned int input_size, 
+                     unsigned char *output, unsigned int output_size, 
+                     const EncoderConfig *config) {
+    if (config->codec == CODEC_GZIP) {
+        int result;
+        if (!inflate_stream) {
+            inflate_stream = calloc(1, sizeof(z_stream));
+            // 15 + 32 takes either a zlib or a gzip header 
+            if (!inflate_stream || inflateInit2(inflate_stream, 15 + 32) != Z_OK) {
+                fprintf(stderr, "inflateInit2 failed\n");
+                free(inflate_stream);
+                inflate_stream = NULL;
+                return -1;
+            }
+        } else {
+            inflateReset(inflate_stream);
+        }
+        z_stream *strm = inflate_stream;
+        strm->next_in = (unsigned char *)input;
+        strm->avail_in = input_size;
+        strm->next_out = output;
+        strm->avail_out = output_size;
+        result = inflate(strm, Z_FINISH);
+        // zlib asks for the dictionary once it has read the header 
+        if (result == Z_NEED_DICT) {
+            if (!config->dict || strm->adler != config->dict->id) {
+                fprintf(stderr, "Block needs a dictionary we don't have\n");
+                return -1;
+            }
+            if (inflateSetDictionary(strm, config->dict->data, config->dict->size) != Z_OK) {
+                fprintf(stderr, "Wrong dictionary for this block\n");
+                return -1;
+            }
+            result = inflate(strm, Z_FINISH);
+        }
+        unsigned int produced = output_size - strm->avail_out;
+        if (result != Z_STREAM_END || produced != output_size) {
+            fprintf(stderr, "inflate failed with error %d\n", result);
+            return -1;
+        }
+        return 0;
+    }
+    // the mode byte says which stage coded the block 
+    if (config->codec == CODEC_BWT || config->codec == CODEC_BWT_HUFF) {
+        if (bwt_decode(input, input_size, output, output_size) != 0) {
+            fprintf(stderr, "bwt decoding failed\n");
+            return -1;
+        }
+        return 0;
+    }
+    unsigned int produced = output_size;
+    int result = BZ2_bzBuffToBuffDecompress((char *)output, &produced, (char *)input, 
+                                            input_size, config->small, 0);
+    if (result != BZ_OK || produced != output_size) {
+        fprintf(stderr, "BZ2_bzBuffToBuffDecompress failed with error %d\n", result);
+        return -1;
+    }
+    return 0;
+}
+
+void codec_thread_cleanup(void) {
+    if (primed_stream) {
+        deflateEnd(primed_stream);
+        free(primed_stream);
+        primed_stream = NULL;
+        primed_dict = NULL;
+    }
+    if (inflate_stream) {
+        inflateEnd(inflate_stream);
+        free(inflate_stream);
+        inflate_stream = NULL;
+    }
+    huffman_thread_cleanup();
+}
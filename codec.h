@@ -0,0 +1,39 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include "block.h"
+#include "dict.h"
+
+typedef enum {
+    CODEC_BZIP2,
+    CODEC_GZIP,
+    CODEC_BWT, // in-house, see bwt.h - only inside our container
+    CODEC_BWT_HUFF // same transform with bzip2 style huffman tables
+} CodecId;
+
+// which encoder and level a block is compressed with
+typedef struct {
+    CodecId codec;
+    int level;
+    int container; // blocks get framed by us, so gz uses the lighter zlib wrapper
+    const Dictionary *dict; // shared dictionary (gz only, needs the container)
+    int small; // decode bz2 with libbzip2's small memory mode
+} EncoderConfig;
+
+// parse "name[:level]" - anything after a further ':' is handed back in
+// rest (NULL when the spec ends after the level)
+int parse_encoder(const char *spec, EncoderConfig *config, const char **rest);
+const char *codec_name(CodecId codec);
+// compress one block with the given encoder
+int compress_block(unsigned char *input, unsigned int input_size, 
+                   CompressedBlock *output, const EncoderConfig *config);
+// undo compress_block - output_size must be the block's original size
+int decompress_block(const unsigned char *input, unsigned int input_size, 
+                     unsigned char *output, unsigned int output_size, 
+                     const EncoderConfig *config);
+// free what the calling thread kept between blocks (primed deflate and 
+// inflate streams, huffman seeds) - every thread that coded blocks calls it 
+// before its parallel region ends 
+void codec_thread_cleanup(void);
+
+#endif
@@ -0,0 +1,64 @@
+#include <string.h>
+#include "container.h"
+
+void put_u32(unsigned char *p, unsigned int value) {
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+unsigned int get_u32(const unsigned char *p) {
+    return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+void container_put_header(unsigned char *out, const ContainerHeader *header) {
+    memcpy(out, CONTAINER_MAGIC, 4);
+    out[4] = CONTAINER_VERSION;
+    out[5] = header->flags;
+    out[6] = header->window_log;
+    out[7] = 0;
+    put_u32(out + 8, header->dict_id);
+}
+
+int container_get_header(const unsigned char *in, ContainerHeader *header) {
+    if (memcmp(in, CONTAINER_MAGIC, 4) != 0 || in[4] != CONTAINER_VERSION) {
+        return -1;
+    }
+    header->flags = in[5];
+    header->window_log = in[6];
+    header->dict_id = get_u32(in + 8);
+    return 0;
+}
+
+void container_put_block(unsigned char *out, const BlockHeader *header) {
+    put_u32(out, header->original_size);
+    put_u32(out + 4, header->raw_size);
+    put_u32(out + 8, header->compressed_size);
+    out[12] = header->codec;
+    out[13] = header->filter;
+    out[14] = header->filter_param;
+    out[15] = 0;
+}
+
+void container_get_block(const unsigned char *in, BlockHeader *header) {
+    header->original_size = get_u32(in);
+    header->raw_size = get_u32(in + 4);
+    header->compressed_size = get_u32(in + 8);
+    header->codec = in[12];
+    header->filter = in[13];
+    header->filter_param = in[14];
+}
+
+int container_is_end(const BlockHeader *header) {
+    return header->original_size == 0 && header->compressed_size == 0;
+}
+
+void container_describe(const CompressedBlock *block, BlockHeader *header) {
+    header->original_size = block->original_size;
+    header->raw_size = block->raw_size;
+    header->compressed_size = block->size;
+    header->codec = block->codec;
+    header->filter = block->filter;
+    header->filter_param = block->filter_param;
+}
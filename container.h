@@ -0,0 +1,55 @@
+#ifndef CONTAINER_H
+#define CONTAINER_H
+
+#include "block.h"
+
+// blocks that plain bzip2/gzip can't describe (shared dictionary, filters,
+// in-house codecs) are framed in our own container:
+//   file header:  "PBZC" u8 version u8 flags u8 window_log u8 reserved u32 dict_id
+//   per block:    u32 original_size u32 raw_size u32 compressed_size
+//                 u8 codec u8 filter u8 filter_param u8 reserved, then the data
+//   end:          a block header of all zeros
+// with CONTAINER_FLAG_CRC every block's data is followed by u32 crc of its
+// original bytes, and the end by u32 crc of the whole output (see crc.h)
+// everything little endian
+#define CONTAINER_MAGIC "PBZC"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 12
+#define BLOCK_HEADER_SIZE 16
+
+// blocks were compressed against a shared dictionary
+#define CONTAINER_FLAG_DICT 1
+// blocks may reference earlier blocks up to 2^window_log bytes back
+#define CONTAINER_FLAG_LONG_RANGE 2
+// block and stream crcs follow the data
+#define CONTAINER_FLAG_CRC 4
+#define CRC_SIZE 4
+
+typedef struct {
+    int flags;
+    unsigned int dict_id; // adler32 of the dictionary
+    int window_log; // long range window
+} ContainerHeader;
+
+typedef struct {
+    unsigned int original_size;
+    unsigned int raw_size; // bytes the codec produced on decode
+    unsigned int compressed_size;
+    int codec;
+    int filter;
+    int filter_param;
+} BlockHeader;
+
+void container_put_header(unsigned char *out, const ContainerHeader *header);
+// -1 when the bytes are not one of our containers
+int container_get_header(const unsigned char *in, ContainerHeader *header);
+void container_put_block(unsigned char *out, const BlockHeader *header);
+void container_get_block(const unsigned char *in, BlockHeader *header);
+// the all zero header that ends a container
+int container_is_end(const BlockHeader *header);
+void container_describe(const CompressedBlock *block, BlockHeader *header);
+
+void put_u32(unsigned char *p, unsigned int value);
+unsigned int get_u32(const unsigned char *p);
+
+#endif
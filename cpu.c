@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "cpu.h"
+
+static const char *names[CPU_LEVELS] = {"generic", "sse2", "avx2", "avx512"};
+static CpuLevel detected = CPU_GENERIC;
+static int forced = -1;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void detect(void) {
+#ifdef CPU_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) {
+        detected = CPU_SSE2;
+    }
+    if (detected == CPU_SSE2 && __builtin_cpu_supports("avx2")) {
+        detected = CPU_AVX2;
+    }
+    if (detected == CPU_AVX2 && __builtin_cpu_supports("avx512f") && 
+        __builtin_cpu_supports("avx512bw")) {
+        detected = CPU_AVX512;
+    }
+#endif
+}
+
+CpuLevel cpu_detect(void) {
+    pthread_once(&once, detect);
+    return detected;
+}
+
+CpuLevel cpu_level(void) {
+    return forced >= 0 ? (CpuLevel)forced : cpu_detect();
+}
+
+int cpu_force_level(CpuLevel level) {
+    if (level > cpu_detect()) {
+        return -1;
+    }
+    forced = level;
+    return 0;
+}
+
+int parse_cpu_level(const char *name, CpuLevel *level) {
+    for (int i = 0; i < CPU_LEVELS; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *level = i;
+            return 0;
+        }
+    }
+    fprintf(stderr, "Unknown cpu level '%s' (generic, sse2, avx2 or avx512)\n", name);
+    return -1;
+}
+
+const char *cpu_level_name(CpuLevel level) {
+    return level < CPU_LEVELS ? names[level] : "?";
+}
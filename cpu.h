@@ -0,0 +1,31 @@
+#ifndef CPU_H
+#define CPU_H
+
+// vector levels the hot kernels (scanning, filters, selector costs, crc) 
+// come in - each level includes the ones below it, AVX-512 means F + BW. 
+// kernels pick their variant from cpu_level() when they run, so forcing a 
+// lower level for a benchmark needs no rebuild
+typedef enum {
+    CPU_GENERIC,
+    CPU_SSE2,
+    CPU_AVX2,
+    CPU_AVX512
+} CpuLevel;
+
+#define CPU_LEVELS 4
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_X86 1
+#endif
+
+// the best level this cpu runs
+CpuLevel cpu_detect(void);
+// the level kernels are picked for - detected unless forced lower
+CpuLevel cpu_level(void);
+// -1 when the cpu can't run the level
+int cpu_force_level(CpuLevel level);
+// "generic", "sse2", "avx2" or "avx512"
+int parse_cpu_level(const char *name, CpuLevel *level);
+const char *cpu_level_name(CpuLevel level);
+
+#endif
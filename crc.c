@@ -0,0 +1,175 @@
+#include <pthread.h>
+#include "cpu.h"
+#include "crc.h"
+
+#ifdef CPU_X86
+#define HAVE_PCLMUL 1
+#include <immintrin.h>
+#endif
+
+#define POLY 0x04c11db7u
+
+// table[k][b] is the crc register after byte b and then k zero bytes 
+static uint32_t table[16][256];
+static int have_pclmul;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+// ---- polynomial arithmetic mod POLY, msb first ---- 
+
+static uint32_t multmodp(uint32_t a, uint32_t b) {
+    uint32_t product = 0;
+    for (int i = 31; i >= 0; i--) {
+        product = (product << 1) ^ (product & 0x80000000u ? POLY : 0);
+        if (b >> i & 1) {
+            product ^= a;
+        }
+    }
+    return product;
+}
+
+// x^(8n) mod POLY 
+static uint32_t x8nmodp(uint64_t n) {
+    uint32_t result = 1;
+    uint32_t power = 0x100; // x^8
+    while (n) {
+        if (n & 1) {
+            result = multmodp(result, power);
+        }
+        power = multmodp(power, power);
+        n >>= 1;
+    }
+    return result;
+}
+
+// ---- slice-by-16 ---- 
+
+static uint32_t slice16(uint32_t reg, const unsigned char *p, size_t n) {
+    while (n >= 16) {
+        uint32_t a = reg ^ ((uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | 
+                            (uint32_t)p[2] << 8 | p[3]);
+        reg = table[15][a >> 24] ^ table[14][a >> 16 & 255] ^ 
+              table[13][a >> 8 & 255] ^ table[12][a & 255] ^ 
+              table[11][p[4]] ^ table[10][p[5]] ^ table[9][p[6]] ^ table[8][p[7]] ^ 
+              table[7][p[8]] ^ table[6][p[9]] ^ table[5][p[10]] ^ table[4][p[11]] ^ 
+              table[3][p[12]] ^ table[2][p[13]] ^ table[1][p[14]] ^ table[0][p[15]];
+        p += 16;
+        n -= 16;
+    }
+    while (n--) {
+        reg = reg << 8 ^ table[0][(reg >> 24) ^ *p++];
+    }
+    return reg;
+}
+
+// ---- carry-less multiply folding ---- 
+
+#ifdef HAVE_PCLMUL
+// x^n mod POLY for the fold distances, filled in with the tables 
+static uint32_t k128, k192, k512, k576;
+
+// a 128 bit lane moved d bits further along: its high half times 
+// x^(d+64), its low half times x^d, both mod POLY 
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i fold(__m128i x, __m128i k) {
+    return _mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x11), _mm_clmulepi64_si128(x, k, 0x00));
+}
+
+// lanes hold the message msb first, so the first byte lands on top 
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i load_be(const unsigned char *p) {
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), reverse);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint32_t pclmul(uint32_t reg, const unsigned char *p, size_t n) {
+    if (n < 64) {
+        return slice16(reg, p, n);
+    }
+    // the register so far is the same as xoring it into the first 4 bytes 
+    __m128i x0 = _mm_xor_si128(load_be(p), _mm_set_epi32(reg, 0, 0, 0));
+    __m128i x1 = load_be(p + 16);
+    __m128i x2 = load_be(p + 32);
+    __m128i x3 = load_be(p + 48);
+    p += 64;
+    n -= 64;
+    // four independent lanes, each folded 512 bits ahead 
+    const __m128i by4 = _mm_set_epi64x(k576, k512);
+    while (n >= 64) {
+        x0 = _mm_xor_si128(fold(x0, by4), load_be(p));
+        x1 = _mm_xor_si128(fold(x1, by4), load_be(p + 16));
+        x2 = _mm_xor_si128(fold(x2, by4), load_be(p + 32));
+        x3 = _mm_xor_si128(fold(x3, by4), load_be(p + 48));
+        p += 64;
+        n -= 64;
+    }
+    const __m128i by1 = _mm_set_epi64x(k192, k128);
+    __m128i x = _mm_xor_si128(fold(x0, by1), x1);
+    x = _mm_xor_si128(fold(x, by1), x2);
+    x = _mm_xor_si128(fold(x, by1), x3);
+    while (n >= 16) {
+        x = _mm_xor_si128(fold(x, by1), load_be(p));
+        p += 16;
+        n -= 16;
+    }
+    // what is left is a 128 bit message - the table reduces it 
+    const __m128i reverse = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    unsigned char bytes[16];
+    _mm_storeu_si128((__m128i *)bytes, _mm_shuffle_epi8(x, reverse));
+    return slice16(slice16(0, bytes, 16), p, n);
+}
+#endif
+
+static void crc_init(void) {
+    for (int b = 0; b < 256; b++) {
+        uint32_t reg = (uint32_t)b << 24;
+        for (int i = 0; i < 8; i++) {
+            reg = reg << 1 ^ (reg & 0x80000000u ? POLY : 0);
+        }
+        table[0][b] = reg;
+    }
+    for (int k = 1; k < 16; k++) {
+        for (int b = 0; b < 256; b++) {
+            uint32_t prev = table[k - 1][b];
+            table[k][b] = prev << 8 ^ table[0][prev >> 24];
+        }
+    }
+#ifdef HAVE_PCLMUL
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3")) {
+        k128 = x8nmodp(16);
+        k192 = x8nmodp(24);
+        k512 = x8nmodp(64);
+        k576 = x8nmodp(72);
+        have_pclmul = 1;
+    }
+#endif
+}
+
+// the fold is an SSE-level kernel - a forced generic run gets the tables 
+static int use_pclmul(void) {
+    return have_pclmul && cpu_level() >= CPU_SSE2;
+}
+
+uint32_t crc32_bzip2_update(uint32_t crc, const void *data, size_t size) {
+    pthread_once(&once, crc_init);
+#ifdef HAVE_PCLMUL
+    if (use_pclmul()) {
+        return ~pclmul(~crc, data, size);
+    }
+#endif
+    return ~slice16(~crc, data, size);
+}
+
+uint32_t crc32_bzip2(const void *data, size_t size) {
+    return crc32_bzip2_update(0, data, size);
+}
+
+// the ~0 start and end cancel out, as with zlib's crc32_combine 
+uint32_t crc32_bzip2_combine(uint32_t crc_a, uint32_t crc_b, uint64_t size_b) {
+    return multmodp(x8nmodp(size_b), crc_a) ^ crc_b;
+}
+
+const char *crc32_bzip2_impl(void) {
+    pthread_once(&once, crc_init);
+    return use_pclmul() ? "pclmul" : "slice-by-16";
+}
@@ -0,0 +1,19 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// bzip2's CRC32: polynomial 0x04c11db7 taken msb first, starting from ~0 
+// and inverted at the end - what bzip2 stores per block and per stream
+
+// one shot
+uint32_t crc32_bzip2(const void *data, size_t size);
+// carry on a finished crc over more data
+uint32_t crc32_bzip2_update(uint32_t crc, const void *data, size_t size);
+// crc of A followed by B, from the crcs of both and the length of B
+uint32_t crc32_bzip2_combine(uint32_t crc_a, uint32_t crc_b, uint64_t size_b);
+// the implementation picked for this cpu - "pclmul" or "slice-by-16"
+const char *crc32_bzip2_impl(void);
+
+#endif
@@ -111,10 +111,45 @@ plt.tight_layout()
 plt.savefig('graphs/memory_optimization.png', dpi=300, bbox_inches='tight')
 plt.close()
 
+# Graph 6: Tool Comparison - from bench/bench_tools.py, when it has been run
+import csv
+tools_csv = 'bench/results/tools.csv'
+if os.path.exists(tools_csv):
+    with open(tools_csv) as f:
+        rows = list(csv.DictReader(f))
+    max_threads = max(int(row['threads']) for row in rows)
+    tool_names = list(dict.fromkeys(row['tool'] for row in rows))
+    # whole corpus MB/s at the highest thread count - total bytes over total time
+    def corpus_mb_s(tool, column):
+        picked = [row for row in rows if row['tool'] == tool and
+                  int(row['threads']) == max_threads and row[column]]
+        if not picked:
+            return 0
+        size = sum(int(row['original_bytes']) for row in picked) / 1e6
+        return size / sum(int(row['original_bytes']) / 1e6 / float(row[column]) for row in picked)
+    compress_speed = [corpus_mb_s(tool, 'compress_mb_s') for tool in tool_names]
+    decompress_speed = [corpus_mb_s(tool, 'decompress_mb_s') for tool in tool_names]
+
+    x = np.arange(len(tool_names))
+    fig, ax = plt.subplots(figsize=(10, 6))
+    ax.bar(x - 0.2, compress_speed, 0.4, label='Compress', color=colors[0], alpha=0.8, edgecolor='black')
+    ax.bar(x + 0.2, decompress_speed, 0.4, label='Decompress', color=colors[2], alpha=0.8, edgecolor='black')
+    ax.set_ylabel('Throughput (MB/s)', fontsize=14, fontweight='bold')
+    ax.set_title(f'bzip2 Tools Compared ({max_threads} threads)', fontsize=16, fontweight='bold')
+    ax.set_xticks(x)
+    ax.set_xticklabels(tool_names)
+    ax.legend(fontsize=12)
+    ax.grid(True, alpha=0.3, axis='y')
+    plt.tight_layout()
+    plt.savefig('graphs/tool_comparison.png', dpi=300, bbox_inches='tight')
+    plt.close()
+
 print("All graphs created successfully in 'graphs/' directory!")
 print("\nGenerated files:")
 print("1. thread_speedup.png")
 print("2. thread_efficiency.png")
 print("3. block_size_comparison.png")
 print("4. file_size_scaling.png")
-print("5. memory_optimization.png")
\ No newline at end of file
+print("5. memory_optimization.png")
+if os.path.exists(tools_csv):
+    print("6. tool_comparison.png")
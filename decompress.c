@@ -0,0 +1,784 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <bzlib.h>
+#include <zlib.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "codec.h"
+#include "container.h"
+#include "crc.h"
+#include "decompress.h"
+#include "filter.h"
+#include "logtemplate.h"
+#include "longrange.h"
+#include "output.h"
+#include "scan.h"
+
+// blocks read ahead per thread - bounds memory to a few blocks per worker 
+#define BATCH_PER_THREAD 4
+// libbzip2's decoder state per 100k of block size level, fast and small 
+#define BZIP2_FAST_MEMORY 400000
+#define BZIP2_SMALL_MEMORY 250000
+// the small decoder's speed relative to the fast one - 0.8 to 1.0 on 900k 
+// blocks here, it loses more where cache is scarcer 
+#define BZIP2_SMALL_SPEED 0.8
+
+typedef struct {
+    BlockHeader header;
+    unsigned char *compressed;
+    unsigned char *raw; // long range tokens waiting for their turn to expand
+    unsigned char *data;
+    unsigned int crc; // what the block's original bytes should hash to
+} PendingBlock;
+
+static int read_exact(FILE *input, unsigned char *buffer, size_t size) {
+    return fread(buffer, 1, size, input) == size ? 0 : -1;
+}
+
+// rough bytes a worker allocates to decode one block, besides the block's 
+// own buffers 
+static long long decode_memory(const PendingBlock *pending, int small) {
+    const BlockHeader *header = &pending->header;
+    long long memory = header->filter != FILTER_NONE ? header->raw_size : 0;
+    if (header->codec == CODEC_BZIP2) {
+        // sized by the stream's level, whatever the block holds 
+        int level = header->compressed_size > 3 ? pending->compressed[3] - '0' : 9;
+        if (level < 1 || level > 9) {
+            level = 9;
+        }
+        return memory + (long long)level * (small ? BZIP2_SMALL_MEMORY : BZIP2_FAST_MEMORY);
+    }
+    if (header->codec == CODEC_BWT || header->codec == CODEC_BWT_HUFF) {
+        // last column, LF table and the symbols or the model 
+        return memory + 7LL * header->raw_size;
+    }
+    // inflate's window and tables 
+    return memory + 64 * 1024;
+}
+
+// how many workers decode a batch and with which bzip2 decoder - the most 
+// throughput that fits next to what the batch already holds 
+static int plan_batch(MemoryPlan *plan, const PendingBlock *batch, int count, 
+                      long long held, int *small) {
+    int threads = omp_get_max_threads();
+    *small = 0;
+    if (!plan->limit) {
+        return threads;
+    }
+    long long fast_need = 1;
+    long long small_need = 1;
+    for (int i = 0; i < count; i++) {
+        long long fast = decode_memory(&batch[i], 0);
+        long long compact = decode_memory(&batch[i], 1);
+        fast_need = fast > fast_need ? fast : fast_need;
+        small_need = compact > small_need ? compact : small_need;
+    }
+    long long room = plan->limit - held;
+    int limit = threads < count ? threads : count;
+    long long fast_workers = room > 0 ? room / fast_need : 0;
+    long long small_workers = room > 0 ? room / small_need : 0;
+    fast_workers = fast_workers < limit ? fast_workers : limit;
+    small_workers = small_workers < limit ? small_workers : limit;
+    int workers;
+    if (fast_workers >= 1 && fast_workers >= small_workers * BZIP2_SMALL_SPEED) {
+        workers = fast_workers;
+    } else {
+        // over budget even with one small decoder - run it anyway 
+        workers = small_workers >= 1 ? small_workers : 1;
+        *small = small_need < fast_need;
+    }
+    long long used = held + workers * (*small ? small_need : fast_need);
+    plan->peak = used > plan->peak ? used : plan->peak;
+    plan->workers = !plan->workers || workers < plan->workers ? workers : plan->workers;
+    plan->small |= *small;
+    return workers;
+}
+
+static int crc_matches(const PendingBlock *pending, long long number) {
+    if (crc32_bzip2(pending->data, pending->header.original_size) == pending->crc) {
+        return 1;
+    }
+    fprintf(stderr, "Block %lld fails its crc check\n", number);
+    return 0;
+}
+
+// container: read a batch of blocks, decode them in parallel, write them in 
+// order, repeat 
+static int decompress_container(FILE *input, const ContainerHeader *file_header, 
+                                OutputSink *output, const Dictionary *dict, MemoryPlan *plan, 
+                                long long *total_in, long long *total_out) {
+    if ((file_header->flags & CONTAINER_FLAG_DICT) && 
+        (!dict || dict->id != file_header->dict_id)) {
+        fprintf(stderr, dict ? "Wrong dictionary for this file\n" 
+                             : "This file needs --dict\n");
+        return -1;
+    }
+    // references into earlier blocks resolve against what was written 
+    LongRangeHistory history;
+    int long_range = (file_header->flags & CONTAINER_FLAG_LONG_RANGE) != 0;
+    if (long_range && (file_header->window_log < 20 || file_header->window_log > 40)) {
+        fprintf(stderr, "Bad long range window\n");
+        return -1;
+    }
+    history_init(&history, long_range ? 1LL << file_header->window_log : 0);
+    int crc = (file_header->flags & CONTAINER_FLAG_CRC) != 0;
+    unsigned int stream_crc = 0;
+    int batch_size = omp_get_max_threads() * BATCH_PER_THREAD;
+    PendingBlock *batch = calloc(batch_size, sizeof(PendingBlock));
+    if (!batch) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    int result = 0;
+    int finished = 0;
+    long long block_number = 0;
+    while (!finished && result == 0) {
+        // read ahead - under a memory limit the buffers get half of it 
+        int count = 0;
+        long long held = history.window;
+        while (count < batch_size && (!plan->limit || count == 0 || held < plan->limit / 2)) {
+            unsigned char raw[BLOCK_HEADER_SIZE];
+            if (read_exact(input, raw, sizeof(raw)) != 0) {
+                fprintf(stderr, "Truncated container\n");
+                result = -1;
+                break;
+            }
+            PendingBlock *pending = &batch[count];
+            container_get_block(raw, &pending->header);
+            if (container_is_end(&pending->header)) {
+                finished = 1;
+                break;
+            }
+            pending->compressed = malloc(pending->header.compressed_size ? 
+                                         pending->header.compressed_size : 1);
+            pending->data = malloc(pending->header.original_size ? 
+                                   pending->header.original_size : 1);
+            count++;
+            if (!pending->compressed || !pending->data) {
+                fprintf(stderr, "Memory allocation failed\n");
+                result = -1;
+                break;
+            }
+            if (read_exact(input, pending->compressed, pending->header.compressed_size) != 0) {
+                fprintf(stderr, "Truncated container\n");
+                result = -1;
+                break;
+            }
+            *total_in += BLOCK_HEADER_SIZE + pending->header.compressed_size;
+            held += pending->header.compressed_size + pending->header.original_size;
+            if (crc) {
+                unsigned char trailer[CRC_SIZE];
+                if (read_exact(input, trailer, sizeof(trailer)) != 0) {
+                    fprintf(stderr, "Truncated container\n");
+                    result = -1;
+                    break;
+                }
+                pending->crc = get_u32(trailer);
+                *total_in += CRC_SIZE;
+            }
+        }
+        // decode 
+        int small = 0;
+        int workers = result == 0 ? plan_batch(plan, batch, count, held, &small) : 1;
+        int errors = 0;
+        #pragma omp parallel num_threads(workers)
+        {
+            #pragma omp for schedule(dynamic)
+            for (int i = 0; i < (result == 0 ? count : 0); i++) {
+                PendingBlock *pending = &batch[i];
+                EncoderConfig config = {pending->header.codec, 0, 1, dict, small};
+                FilterConfig filter = {pending->header.filter, pending->header.filter_param};
+                // filtered blocks decode to a scratch buffer and are unfiltered 
+                // into place 
+                unsigned int raw_size = pending->header.raw_size;
+                unsigned char *raw = filter.id != FILTER_NONE ? 
+                                     malloc(raw_size ? raw_size : 1) : pending->data;
+                int failed = 0;
+                int known = filter.id <= FILTER_BCJ ? 
+                            pending->header.raw_size == pending->header.original_size : 
+                            filter.id == FILTER_LOG || 
+                            (filter.id == FILTER_LONG_RANGE && long_range);
+                // sectioned log blocks code each of their streams on its own 
+                int sections = filter.id == FILTER_LOG && filter.param == LOG_PARAM_SECTIONS;
+                if (!raw || !known || 
+                    (sections ? log_template_decompress(pending->compressed, 
+                                                        pending->header.compressed_size, raw, 
+                                                        pending->header.raw_size, &config) : 
+                                decompress_block(pending->compressed, 
+                                                 pending->header.compressed_size, 
+                                                 raw, pending->header.raw_size, &config)) != 0) {
+                    fprintf(stderr, "Block %lld failed to decode\n", block_number + i);
+                    failed = 1;
+                } else if (filter.id == FILTER_LONG_RANGE) {
+                    // expanded below, once every earlier block is written 
+                    pending->raw = raw;
+                    raw = pending->data;
+                } else if (filter.id == FILTER_LOG) {
+                    if (log_template_decode(raw, pending->header.raw_size, pending->data, 
+                                            pending->header.original_size) != 0) {
+                        fprintf(stderr, "Block %lld has bad log templates\n", block_number + i);
+                        failed = 1;
+                    }
+                } else if (raw != pending->data) {
+                    filter_decode(&filter, raw, pending->data, pending->header.original_size);
+                }
+                if (raw != pending->data) {
+                    free(raw);
+                }
+                // long range blocks are checked once they are expanded 
+                if (!failed && crc && filter.id != FILTER_LONG_RANGE && 
+                    !crc_matches(pending, block_number + i)) {
+                    failed = 1;
+                }
+                if (failed) {
+                    #pragma omp atomic
+                    errors++;
+                }
+            }
+            // drop the inflate stream this thread kept between blocks 
+            codec_thread_cleanup();
+        }
+        if (errors > 0) {
+            result = -1;
+        }
+        // write in order and drop the batch 
+        for (int i = 0; i < count; i++) {
+            if (result == 0 && batch[i].raw && 
+                long_range_expand(batch[i].raw, batch[i].header.raw_size, batch[i].data, 
+                                  batch[i].header.original_size, &history) != 0) {
+                fprintf(stderr, "Block %lld has a bad long range reference\n", 
+                        block_number + i);
+                result = -1;
+            }
+            if (result == 0 && crc && batch[i].raw && !crc_matches(&batch[i], block_number + i)) {
+                result = -1;
+            }
+            if (result == 0 && long_range && 
+                history_append(&history, batch[i].data, batch[i].header.original_size) != 0) {
+                result = -1;
+            }
+            if (result == 0) {
+                if (sink_write(output, batch[i].data, batch[i].header.original_size) != 0) {
+                    perror(output->path);
+                    result = -1;
+                }
+                *total_out += batch[i].header.original_size;
+                stream_crc = crc32_bzip2_combine(stream_crc, batch[i].crc, 
+                                                 batch[i].header.original_size);
+            }
+            free(batch[i].compressed);
+            free(batch[i].raw);
+            free(batch[i].data);
+            batch[i].compressed = batch[i].raw = batch[i].data = NULL;
+        }
+        block_number += count;
+    }
+    // every block matched its own crc - this catches blocks lost, repeated 
+    // or reordered as a whole 
+    if (result == 0 && crc) {
+        unsigned char trailer[CRC_SIZE];
+        if (read_exact(input, trailer, sizeof(trailer)) != 0) {
+            fprintf(stderr, "Truncated container\n");
+            result = -1;
+        } else if (get_u32(trailer) != stream_crc) {
+            fprintf(stderr, "Stream crc mismatch\n");
+            result = -1;
+        } else {
+            *total_in += CRC_SIZE;
+        }
+    }
+    free(batch);
+    history_free(&history);
+    return result;
+}
+
+// plain bzip2 (one or many streams) - decoded in one go 
+static int decompress_bzip2(FILE *input, const unsigned char *head, size_t head_size, 
+                            OutputSink *output, MemoryPlan *plan, 
+                            long long *total_in, long long *total_out) {
+    enum { CHUNK = 1 << 20 };
+    // one decoder and two chunks - small mode when the fast one won't fit 
+    int level = head_size > 3 && head[3] >= '1' && head[3] <= '9' ? head[3] - '0' : 9;
+    long long fast = 2LL * CHUNK + level * BZIP2_FAST_MEMORY;
+    int small = plan->limit && fast > plan->limit;
+    plan->workers = 1;
+    plan->small = small;
+    plan->peak = small ? 2LL * CHUNK + level * BZIP2_SMALL_MEMORY : fast;
+    char *in = malloc(CHUNK);
+    char *out = malloc(CHUNK);
+    if (!in || !out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(in);
+        free(out);
+        return -1;
+    }
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    int result = BZ2_bzDecompressInit(&strm, 0, small) == BZ_OK ? 0 : -1;
+    memcpy(in, head, head_size);
+    strm.next_in = in;
+    strm.avail_in = head_size;
+    int eof = 0;
+    while (result == 0) {
+        if (strm.avail_in == 0 && !eof) {
+            size_t n = fread(in, 1, CHUNK, input);
+            eof = n == 0;
+            strm.next_in = in;
+            strm.avail_in = n;
+            *total_in += n;
+        }
+        strm.next_out = out;
+        strm.avail_out = CHUNK;
+        int status = BZ2_bzDecompress(&strm);
+        size_t produced = CHUNK - strm.avail_out;
+        if (produced && sink_write(output, (unsigned char *)out, produced) != 0) {
+            perror(output->path);
+            result = -1;
+            break;
+        }
+        *total_out += produced;
+        if (status == BZ_STREAM_END) {
+            // concatenated streams - start over on whatever is left 
+            char *next = strm.next_in;
+            unsigned int left = strm.avail_in;
+            BZ2_bzDecompressEnd(&strm);
+            memset(&strm, 0, sizeof(strm));
+            if (left == 0) {
+                size_t n = fread(in, 1, CHUNK, input);
+                // clean end of the last stream 
+                if (n == 0) {
+                    break;
+                }
+                next = in;
+                left = n;
+                *total_in += n;
+            }
+            if (BZ2_bzDecompressInit(&strm, 0, small) != BZ_OK) {
+                result = -1;
+                break;
+            }
+            strm.next_in = next;
+            strm.avail_in = left;
+        } else if (status != BZ_OK || (eof && produced == 0 && strm.avail_in == 0)) {
+            fprintf(stderr, "bzip2 data is corrupt or truncated (error %d)\n", status);
+            result = -1;
+        }
+    }
+    if (strm.state) {
+        BZ2_bzDecompressEnd(&strm);
+    }
+    free(in);
+    free(out);
+    return result;
+}
+
+// ---- plain bzip2, split at its stream and block magics ---- 
+
+// one block cut out of its stream, decoded as a stream of its own 
+typedef struct {
+    long long start; // bit offset of the block magic
+    long long end; // bit offset of the next block or end magic
+    long long stream_end; // bit offset of its stream's end magic
+    unsigned int stream_crc; // what the blocks of that stream combine to
+    int level;
+    int skip; // merged into an earlier piece
+    int ok;
+    unsigned char *data;
+    size_t size;
+} BzipPiece;
+
+// 32 big endian bits at a bit offset 
+static unsigned int get_bits32(const unsigned char *data, long long size, long long bit) {
+    uint64_t value = 0;
+    for (int k = 0; k < 5; k++) {
+        long long i = (bit >> 3) + k;
+        value = value << 8 | (i < size ? data[i] : 0);
+    }
+    return value >> (8 - (bit & 7)) & 0xFFFFFFFFu;
+}
+
+static void put_bits(unsigned char *out, long long bit, uint64_t value, int count) {
+    for (int k = count - 1; k >= 0; k--, bit++) {
+        if (value >> k & 1) {
+            out[bit >> 3] |= 0x80 >> (bit & 7);
+        }
+    }
+}
+
+// "BZh" level, the block's bits moved to a byte boundary, and an end magic 
+// whose stream crc is the block's own - what bzip2recover writes 
+static unsigned char *wrap_piece(const unsigned char *data, long long size, 
+                                 const BzipPiece *piece, size_t *wrapped_size) {
+    long long bits = piece->end - piece->start;
+    size_t bytes = 4 + (bits + 80 + 7) / 8;
+    unsigned char *out = calloc(bytes, 1);
+    if (!out) {
+        return NULL;
+    }
+    out[0] = 'B';
+    out[1] = 'Z';
+    out[2] = 'h';
+    out[3] = '0' + piece->level;
+    long long from = piece->start >> 3;
+    int shift = piece->start & 7;
+    for (long long k = 0; k < (bits + 7) / 8; k++) {
+        unsigned int next = from + k + 1 < size ? data[from + k + 1] : 0;
+        out[4 + k] = shift ? data[from + k] << shift | next >> (8 - shift) : data[from + k];
+    }
+    if (bits & 7) {
+        out[4 + (bits - 1) / 8] &= 0xFF << (8 - (bits & 7));
+    }
+    put_bits(out, 32 + bits, BZIP2_END_MAGIC, 48);
+    put_bits(out, 32 + bits + 48, get_bits32(data, size, piece->start + 48), 32);
+    *wrapped_size = bytes;
+    return out;
+}
+
+static void decode_piece(const unsigned char *data, long long size, BzipPiece *piece) {
+    free(piece->data);
+    piece->data = NULL;
+    piece->size = 0;
+    piece->ok = 0;
+    size_t wrapped_size;
+    unsigned char *wrapped = wrap_piece(data, size, piece, &wrapped_size);
+    size_t capacity = piece->level * 100000 + 4096;
+    unsigned char *out = malloc(capacity);
+    bz_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (!wrapped || !out || BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) {
+        free(wrapped);
+        free(out);
+        return;
+    }
+    strm.next_in = (char *)wrapped;
+    strm.avail_in = wrapped_size;
+    int status = BZ_OK;
+    while (status == BZ_OK) {
+        // runs of one byte shrink before the block size limit, so the 
+        // output can be many times the block size 
+        if (piece->size == capacity) {
+            unsigned char *grown = realloc(out, capacity * 2);
+            if (!grown) {
+                break;
+            }
+            out = grown;
+            capacity *= 2;
+        }
+        strm.next_out = (char *)out + piece->size;
+        strm.avail_out = capacity - piece->size;
+        status = BZ2_bzDecompress(&strm);
+        piece->size = capacity - strm.avail_out;
+        if (status == BZ_OK && strm.avail_in == 0 && strm.avail_out > 0) {
+            break;
+        }
+    }
+    BZ2_bzDecompressEnd(&strm);
+    free(wrapped);
+    piece->ok = status == BZ_STREAM_END && strm.avail_in == 0;
+    piece->data = out;
+}
+
+// blocks of every stream as pieces - 1 when the magics don't add up to a 
+// clean run of streams and the file has to be decoded serially 
+static int plan_pieces(const unsigned char *data, long long size, BzipPiece **pieces_out, 
+                       long long *count_out) {
+    OffsetList streams = {NULL, 0, 0};
+    OffsetList blocks = {NULL, 0, 0};
+    if (scan_streams(data, size, &streams) != 0 || 
+        scan_magic(data, size, 0, size * 8, BZIP2_BLOCK_MAGIC, &blocks) != 0) {
+        offsets_free(&streams);
+        offsets_free(&blocks);
+        return -1;
+    }
+    BzipPiece *pieces = calloc(blocks.count ? blocks.count : 1, sizeof(BzipPiece));
+    long long count = 0;
+    long long next_block = 0;
+    int result = streams.count && streams.offsets[0] == 0 && pieces ? 0 : 1;
+    for (long long s = 0; s < streams.count && result == 0;) {
+        long long first = (streams.offsets[s] + 4) * 8;
+        // the end magic and crc sit right before the next stream, padded 
+        // to a byte - a candidate with no end magic in front of it was 
+        // chance bytes inside this stream 
+        long long stream_end = -1;
+        long long next = s + 1;
+        for (;; next++) {
+            long long end_byte = next < streams.count ? streams.offsets[next] : size;
+            for (int pad = 0; pad < 8 && stream_end < 0; pad++) {
+                long long bit = end_byte * 8 - 80 - pad;
+                if (bit >= first && 
+                    ((uint64_t)get_bits32(data, size, bit) << 16 | 
+                     get_bits32(data, size, bit + 32) >> 16) == BZIP2_END_MAGIC) {
+                    stream_end = bit;
+                }
+            }
+            if (stream_end >= 0 || next >= streams.count) {
+                break;
+            }
+        }
+        if (stream_end < 0) {
+            result = 1;
+            break;
+        }
+        unsigned int stream_crc = get_bits32(data, size, stream_end + 48);
+        while (next_block < blocks.count && blocks.offsets[next_block] < first) {
+            next_block++;
+        }
+        // the first block follows the header directly 
+        if (stream_end > first && 
+            (next_block == blocks.count || blocks.offsets[next_block] != first)) {
+            result = 1;
+            break;
+        }
+        for (; next_block < blocks.count && blocks.offsets[next_block] < stream_end; next_block++) {
+            BzipPiece *piece = &pieces[count++];
+            piece->start = blocks.offsets[next_block];
+            piece->end = next_block + 1 < blocks.count && 
+                         blocks.offsets[next_block + 1] < stream_end ? 
+                         blocks.offsets[next_block + 1] : stream_end;
+            piece->stream_end = stream_end;
+            piece->stream_crc = stream_crc;
+            piece->level = data[streams.offsets[s] + 3] - '0';
+        }
+        s = next < streams.count ? next : streams.count;
+    }
+    offsets_free(&streams);
+    offsets_free(&blocks);
+    if (result != 0) {
+        free(pieces);
+        return result;
+    }
+    *pieces_out = pieces;
+    *count_out = count;
+    return 0;
+}
+
+// decode a mapped bzip2 file block by block on every worker - 1 when it 
+// has to go through the serial decoder instead 
+static int decompress_bzip2_split(const unsigned char *data, long long size, 
+                                  OutputSink *output, MemoryPlan *plan, 
+                                  long long *total_in, long long *total_out) {
+    // a worker holds its decoder and a batch share of output blocks 
+    int threads = omp_get_max_threads();
+    long long per_worker = 9LL * (BZIP2_FAST_MEMORY + 100000 * (1 + BATCH_PER_THREAD));
+    if (plan->limit && plan->limit / per_worker < 2) {
+        return 1;
+    }
+    if (plan->limit && plan->limit / per_worker < threads) {
+        threads = plan->limit / per_worker;
+    }
+    BzipPiece *pieces;
+    long long count;
+    int result = plan_pieces(data, size, &pieces, &count);
+    if (result != 0) {
+        return result;
+    }
+    plan->workers = threads;
+    plan->peak = threads * per_worker;
+    long long batch_size = threads * BATCH_PER_THREAD;
+    unsigned int combined = 0;
+    for (long long first = 0; first < count && result == 0; first += batch_size) {
+        long long last = first + batch_size < count ? first + batch_size : count;
+        #pragma omp parallel for schedule(dynamic) num_threads(threads)
+        for (long long i = first; i < last; i++) {
+            if (!pieces[i].skip) {
+                decode_piece(data, size, &pieces[i]);
+            }
+        }
+        for (long long i = first; i < last; i++) {
+            BzipPiece *piece = &pieces[i];
+            if (piece->skip || result != 0) {
+                free(piece->data);
+                piece->data = NULL;
+                continue;
+            }
+            // a failed piece ends at a chance magic inside its block - 
+            // take in the next one and try again 
+            for (long long j = i + 1; !piece->ok && piece->end < piece->stream_end; j++) {
+                piece->end = pieces[j].end;
+                pieces[j].skip = 1;
+                free(pieces[j].data);
+                pieces[j].data = NULL;
+                decode_piece(data, size, piece);
+            }
+            if (!piece->ok) {
+                fprintf(stderr, "bzip2 data is corrupt at bit %lld\n", piece->start);
+                result = -1;
+            }
+            combined = (combined << 1 | combined >> 31) ^ get_bits32(data, size, piece->start + 48);
+            if (result == 0 && piece->end == piece->stream_end) {
+                if (combined != piece->stream_crc) {
+                    fprintf(stderr, "bzip2 stream crc mismatch\n");
+                    result = -1;
+                }
+                combined = 0;
+            }
+            if (result == 0 && sink_write(output, piece->data, piece->size) != 0) {
+                perror(output->path);
+                result = -1;
+            }
+            *total_out += piece->size;
+            free(piece->data);
+            piece->data = NULL;
+        }
+    }
+    free(pieces);
+    *total_in = size;
+    return result;
+}
+
+// plain gz output is one gzip member per block - inflated in order, as 
+// nothing says where the members start 
+static int decompress_gzip(FILE *input, const unsigned char *head, size_t head_size, 
+                           OutputSink *output, MemoryPlan *plan, 
+                           long long *total_in, long long *total_out) {
+    enum { CHUNK = 1 << 20 };
+    // inflate keeps a 32k window plus a few k of tables 
+    plan->workers = 1;
+    plan->small = 0;
+    plan->peak = 2LL * CHUNK + 48 * 1024;
+    unsigned char *in = malloc(CHUNK);
+    unsigned char *out = malloc(CHUNK);
+    if (!in || !out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(in);
+        free(out);
+        return -1;
+    }
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    // window bits 15 + 16 only accepts a gzip header 
+    if (inflateInit2(&strm, 15 + 16) != Z_OK) {
+        free(in);
+        free(out);
+        return -1;
+    }
+    memcpy(in, head, head_size);
+    strm.next_in = in;
+    strm.avail_in = head_size;
+    int eof = 0;
+    int result = 0;
+    while (result == 0) {
+        if (strm.avail_in == 0 && !eof) {
+            size_t n = fread(in, 1, CHUNK, input);
+            eof = n == 0;
+            strm.next_in = in;
+            strm.avail_in = n;
+            *total_in += n;
+        }
+        strm.next_out = out;
+        strm.avail_out = CHUNK;
+        int status = inflate(&strm, Z_NO_FLUSH);
+        size_t produced = CHUNK - strm.avail_out;
+        if (produced && sink_write(output, out, produced) != 0) {
+            perror(output->path);
+            result = -1;
+            break;
+        }
+        *total_out += produced;
+        if (status == Z_STREAM_END) {
+            // next member, if there is one 
+            if (strm.avail_in == 0) {
+                size_t n = fread(in, 1, CHUNK, input);
+                if (n == 0) {
+                    break;
+                }
+                strm.next_in = in;
+                strm.avail_in = n;
+                *total_in += n;
+            }
+            if (inflateReset(&strm) != Z_OK) {
+                result = -1;
+            }
+        } else if ((status != Z_OK && status != Z_BUF_ERROR) || 
+                   (eof && produced == 0 && strm.avail_in == 0)) {
+            fprintf(stderr, "gzip data is corrupt or truncated (error %d)\n", status);
+            result = -1;
+        }
+    }
+    inflateEnd(&strm);
+    free(in);
+    free(out);
+    return result;
+}
+
+int decompress_file(const char *input_filename, const char *output_filename, 
+                    const Dictionary *dict, long long mem_limit, FILE *report) {
+    FILE *input = strcmp(input_filename, "-") == 0 ? stdin : fopen(input_filename, "rb");
+    if (!input) {
+        perror("Error opening input file");
+        return -1;
+    }
+    OutputSink output;
+    if (sink_open(&output, output_filename, 0) != 0) {
+        if (input != stdin) {
+            fclose(input);
+        }
+        return -1;
+    }
+    double start_time = omp_get_wtime();
+    long long total_in = 0;
+    long long total_out = 0;
+    int result;
+    unsigned char head[CONTAINER_HEADER_SIZE];
+    size_t head_size = fread(head, 1, sizeof(head), input);
+    ContainerHeader file_header;
+    MemoryPlan plan = {mem_limit, 0, 0, 0};
+    if (head_size == sizeof(head) && container_get_header(head, &file_header) == 0) {
+        total_in = head_size;
+        result = decompress_container(input, &file_header, &output, dict, &plan, 
+                                      &total_in, &total_out);
+    } else if (head_size >= 3 && memcmp(head, "BZh", 3) == 0) {
+        // a regular file is mapped and split into blocks for the workers 
+        result = 1;
+        struct stat st;
+        if (fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(input), 0);
+            if (map != MAP_FAILED) {
+                result = decompress_bzip2_split(map, st.st_size, &output, &plan, 
+                                                &total_in, &total_out);
+                munmap(map, st.st_size);
+            }
+        }
+        if (result == 1) {
+            total_in = head_size;
+            result = decompress_bzip2(input, head, head_size, &output, &plan, 
+                                      &total_in, &total_out);
+        }
+    } else if (head_size >= 2 && head[0] == 0x1f && head[1] == 0x8b) {
+        total_in = head_size;
+        result = decompress_gzip(input, head, head_size, &output, &plan, 
+                                 &total_in, &total_out);
+    } else {
+        fprintf(stderr, "%s is not a container, bzip2 or gzip file\n", input_filename);
+        result = -1;
+    }
+    if (input != stdin) {
+        fclose(input);
+    }
+    if (result == 0) {
+        result = sink_close(&output);
+    } else {
+        sink_abort(&output);
+    }
+    double elapsed = omp_get_wtime() - start_time;
+    if (result == 0) {
+        fprintf(report, "\nDecompression Statistics:\n");
+        fprintf(report, "Compressed size: %lld bytes\n", total_in);
+        fprintf(report, "Decompressed size: %lld bytes\n", total_out);
+        fprintf(report, "Decompression time: %.3f seconds\n", elapsed);
+        fprintf(report, "Throughput: %.2f MB/s\n", (total_out / (1024.0 * 1024.0)) / elapsed);
+        // what the limit cost - fewer workers and the slower decoder 
+        if (plan.limit) {
+            fprintf(report, "Memory limit: %.1f MB, planned peak %.1f MB\n", 
+                    plan.limit / (1024.0 * 1024.0), plan.peak / (1024.0 * 1024.0));
+            fprintf(report, "Workers: %d of %d%s\n", plan.workers, omp_get_max_threads(), 
+                    plan.small ? ", small bzip2 decoder" : "");
+            if (plan.peak > plan.limit) {
+                fprintf(report, "Warning: one block at a time does not fit the limit\n");
+            }
+        }
+    }
+    return result;
+}
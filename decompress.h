@@ -0,0 +1,24 @@
+#ifndef DECOMPRESS_H
+#define DECOMPRESS_H
+
+#include <stdio.h>
+#include "dict.h"
+
+// what a memory limit made the decoder do
+typedef struct {
+    long long limit; // bytes the decoder may use, 0 = no limit
+    long long peak; // most any batch was planned to use
+    int workers; // fewest workers a batch ran with
+    int small; // bzip2 blocks went through libbzip2's small decoder
+} MemoryPlan;
+
+// undo our output - a container (blocks decoded in parallel batches), a
+// plain bzip2 file (split at its block magics when it can be mapped, see
+// scan.h) or plain gzip members, inflated in order; dict is needed for
+// containers built with one. with a
+// mem_limit batches read ahead less, run on fewer workers and switch to
+// the small bzip2 decoder to stay under it
+int decompress_file(const char *input_filename, const char *output_filename, 
+                    const Dictionary *dict, long long mem_limit, FILE *report);
+
+#endif
@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include <zlib.h>
+#include "dict.h"
+#include "output.h"
+#include "pack.h"
+
+// COVER style training: count how many samples every d-byte string shows 
+// up in, then pick the segments whose strings are most common 
+#define DMER_SIZE 8
+#define SEGMENT_SIZE 64
+#define COUNT_BITS 22
+#define SAMPLE_LIMIT (128 * 1024)
+
+int dict_load(const char *path, Dictionary *dict) {
+    memset(dict, 0, sizeof(*dict));
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0 || st.st_size <= 0 || st.st_size > DICT_MAX_SIZE) {
+        fprintf(stderr, "%s is not a dictionary (1 byte to %d KB)\n", path, DICT_MAX_SIZE / 1024);
+        fclose(fp);
+        return -1;
+    }
+    dict->data = malloc(st.st_size);
+    if (!dict->data || fread(dict->data, 1, st.st_size, fp) != (size_t)st.st_size) {
+        fprintf(stderr, "Error reading %s\n", path);
+        free(dict->data);
+        dict->data = NULL;
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    dict->size = st.st_size;
+    dict->id = adler32(adler32(0, NULL, 0), dict->data, dict->size);
+    return 0;
+}
+
+void dict_free(Dictionary *dict) {
+    free(dict->data);
+    dict->data = NULL;
+    dict->size = 0;
+}
+
+static inline uint32_t dmer_hash(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return (uint32_t)((v * 0x9E3779B185EBCA87ULL) >> (64 - COUNT_BITS));
+}
+
+// a segment's worth is how common its strings are across samples 
+static uint64_t segment_score(const uint32_t *counts, const unsigned char *p) {
+    uint64_t score = 0;
+    for (int i = 0; i + DMER_SIZE <= SEGMENT_SIZE; i++) {
+        score += counts[dmer_hash(p + i)];
+    }
+    return score;
+}
+
+typedef struct {
+    const unsigned char *data;
+    unsigned int size;
+} Sample;
+
+typedef struct {
+    const unsigned char *data;
+    uint64_t score;
+} Segment;
+
+static int compare_segments(const void *a, const void *b) {
+    const Segment *x = a;
+    const Segment *y = b;
+    return (x->score > y->score) - (x->score < y->score);
+}
+
+// read the corpus into one buffer and cut it into samples 
+static unsigned char *load_samples(const char *corpus, unsigned int sample_size, 
+                                   Sample **samples, int *num_samples, long long *total) {
+    struct stat st;
+    if (stat(corpus, &st) != 0) {
+        perror(corpus);
+        return NULL;
+    }
+    PackPlan plan;
+    memset(&plan, 0, sizeof(plan));
+    if (S_ISDIR(st.st_mode)) {
+        // a directory - each file is one record 
+        if (pack_scan(corpus, 1, &plan) != 0) {
+            return NULL;
+        }
+    } else {
+        plan.members = calloc(1, sizeof(PackMember));
+        if (!plan.members) {
+            return NULL;
+        }
+        plan.members[0].path = strdup(corpus);
+        plan.members[0].name = strdup(corpus);
+        plan.members[0].size = st.st_size;
+        plan.num_members = 1;
+    }
+    long long size = 0;
+    int count = 0;
+    for (int i = 0; i < plan.num_members; i++) {
+        unsigned int take = plan.members[i].size < SAMPLE_LIMIT || !S_ISDIR(st.st_mode) ? 
+                            plan.members[i].size : SAMPLE_LIMIT;
+        size += take;
+        count += S_ISDIR(st.st_mode) ? 1 : (take + sample_size - 1) / sample_size;
+    }
+    unsigned char *data = malloc(size ? size : 1);
+    *samples = calloc(count ? count : 1, sizeof(Sample));
+    if (!data || !*samples) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(data);
+        free(*samples);
+        pack_free(&plan);
+        return NULL;
+    }
+    long long offset = 0;
+    int n = 0;
+    for (int i = 0; i < plan.num_members; i++) {
+        unsigned int take = plan.members[i].size < SAMPLE_LIMIT || !S_ISDIR(st.st_mode) ? 
+                            plan.members[i].size : SAMPLE_LIMIT;
+        int fd = open(plan.members[i].path, O_RDONLY);
+        if (fd < 0 || read(fd, data + offset, take) != (ssize_t)take) {
+            fprintf(stderr, "Error reading %s\n", plan.members[i].path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            free(data);
+            free(*samples);
+            pack_free(&plan);
+            return NULL;
+        }
+        close(fd);
+        if (S_ISDIR(st.st_mode)) {
+            (*samples)[n].data = data + offset;
+            (*samples)[n++].size = take;
+        } else {
+            for (unsigned int at = 0; at < take; at += sample_size) {
+                (*samples)[n].data = data + offset + at;
+                (*samples)[n++].size = take - at < sample_size ? take - at : sample_size;
+            }
+        }
+        offset += take;
+    }
+    pack_free(&plan);
+    *num_samples = n;
+    *total = size;
+    return data;
+}
+
+int dict_train(const char *corpus, unsigned int dict_size, unsigned int sample_size, 
+               const char *output_filename, FILE *report) {
+    if (dict_size > DICT_MAX_SIZE) {
+        dict_size = DICT_MAX_SIZE;
+    }
+    Sample *samples = NULL;
+    int num_samples = 0;
+    long long total = 0;
+    unsigned char *corpus_data = load_samples(corpus, sample_size, &samples, &num_samples, &total);
+    if (!corpus_data) {
+        return -1;
+    }
+    double start_time = omp_get_wtime();
+    size_t table_size = (size_t)1 << COUNT_BITS;
+    uint32_t *counts = calloc(table_size, sizeof(uint32_t));
+    if (!counts) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(corpus_data);
+        free(samples);
+        return -1;
+    }
+    // count in parallel - each thread has its own table and a per sample 
+    // "seen" stamp so a string counts once per sample however often it 
+    // repeats inside it 
+    int failed = 0;
+    #pragma omp parallel
+    {
+        uint32_t *local = calloc(table_size, sizeof(uint32_t));
+        uint32_t *seen = calloc(table_size, sizeof(uint32_t));
+        if (!local || !seen) {
+            #pragma omp atomic write
+            failed = 1;
+        }
+        #pragma omp for schedule(dynamic, 64)
+        for (int s = 0; s < num_samples; s++) {
+            if (!local || !seen) {
+                continue;
+            }
+            for (unsigned int i = 0; i + DMER_SIZE <= samples[s].size; i++) {
+                uint32_t h = dmer_hash(samples[s].data + i);
+                if (seen[h] != (uint32_t)s + 1) {
+                    seen[h] = s + 1;
+                    local[h]++;
+                }
+            }
+        }
+        if (local && seen) {
+            #pragma omp critical
+            for (size_t h = 0; h < table_size; h++) {
+                counts[h] += local[h];
+            }
+        }
+        free(local);
+        free(seen);
+    }
+    // strings that only one sample has are useless in a shared dictionary 
+    for (size_t h = 0; h < table_size; h++) {
+        if (counts[h] < 2) {
+            counts[h] = 0;
+        }
+    }
+    // split the corpus into one epoch per segment we want and take the best 
+    // segment of each - epochs are scored in parallel 
+    int num_segments = dict_size / SEGMENT_SIZE;
+    long long epoch_size = total / (num_segments ? num_segments : 1);
+    if (epoch_size < SEGMENT_SIZE) {
+        epoch_size = SEGMENT_SIZE;
+        num_segments = total / SEGMENT_SIZE;
+    }
+    Segment *segments = calloc(num_segments ? num_segments : 1, sizeof(Segment));
+    if (failed || !segments) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(counts);
+        free(segments);
+        free(corpus_data);
+        free(samples);
+        return -1;
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int e = 0; e < num_segments; e++) {
+        const unsigned char *start = corpus_data + e * epoch_size;
+        long long end = epoch_size - SEGMENT_SIZE;
+        for (long long i = 0; i <= end; i += DMER_SIZE) {
+            uint64_t score = segment_score(counts, start + i);
+            if (score > segments[e].score) {
+                segments[e].score = score;
+                segments[e].data = start + i;
+            }
+        }
+    }
+    // least useful first - deflate reaches the end of the dictionary with 
+    // the shortest distances 
+    qsort(segments, num_segments, sizeof(Segment), compare_segments);
+    unsigned char *dict = malloc(dict_size);
+    unsigned int used = 0;
+    if (!dict) {
+        fprintf(stderr, "Memory allocation failed\n");
+    }
+    for (int e = 0; dict && e < num_segments; e++) {
+        if (!segments[e].data || segments[e].score == 0) {
+            continue;
+        }
+        // skip exact repeats of a segment we already have 
+        int duplicate = 0;
+        for (int prev = e - 1; prev >= 0 && segments[prev].score == segments[e].score; prev--) {
+            if (segments[prev].data && memcmp(segments[prev].data, segments[e].data, SEGMENT_SIZE) == 0) {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (!duplicate && used + SEGMENT_SIZE <= dict_size) {
+            memcpy(dict + used, segments[e].data, SEGMENT_SIZE);
+            used += SEGMENT_SIZE;
+        }
+    }
+    double training_time = omp_get_wtime() - start_time;
+    int result = dict ? 0 : -1;
+    if (result == 0 && used == 0) {
+        fprintf(stderr, "Corpus has nothing in common between samples\n");
+        result = -1;
+    }
+    OutputSink output;
+    if (result == 0 && sink_open(&output, output_filename, 0) == 0) {
+        if (sink_write(&output, dict, used) != 0) {
+            perror(output_filename);
+            sink_abort(&output);
+            result = -1;
+        } else {
+            result = sink_close(&output);
+        }
+    } else if (result == 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        fprintf(report, "Samples: %d (%lld bytes)\n", num_samples, total);
+        fprintf(report, "Dictionary size: %u bytes\n", used);
+        fprintf(report, "Training time: %.3f seconds\n", training_time);
+    }
+    free(dict);
+    free(segments);
+    free(counts);
+    free(corpus_data);
+    free(samples);
+    return result;
+}
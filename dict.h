@@ -0,0 +1,22 @@
+#ifndef DICT_H
+#define DICT_H
+
+#include <stdio.h>
+
+// deflate can only look back 32 KB, so a bigger dictionary is wasted
+#define DICT_MAX_SIZE (32 * 1024)
+
+typedef struct {
+    unsigned char *data;
+    unsigned int size;
+    unsigned int id; // adler32 of the data - zlib stores it in every stream
+} Dictionary;
+
+int dict_load(const char *path, Dictionary *dict);
+void dict_free(Dictionary *dict);
+// build a dictionary of up to dict_size bytes from a corpus - a directory
+// (every file is a sample) or a file cut into sample_size records
+int dict_train(const char *corpus, unsigned int dict_size, unsigned int sample_size, 
+               const char *output_filename, FILE *report);
+
+#endif
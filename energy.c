@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <string.h>
+#include <dirent.h>
+#include "energy.h"
+
+#ifndef POWERCAP_ROOT
+#define POWERCAP_ROOT "/sys/class/powercap"
+#endif
+
+// one number from a sysfs file
+static int read_counter(const char *path, unsigned long long *value) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    int result = fscanf(f, "%llu", value) == 1 ? 0 : -1;
+    fclose(f);
+    return result;
+}
+
+static int read_name(const char *zone, char *name, size_t size) {
+    char path[320];
+    snprintf(path, sizeof(path), "%s/%s/name", POWERCAP_ROOT, zone);
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+    int result = fgets(name, size, f) ? 0 : -1;
+    fclose(f);
+    name[strcspn(name, "\n")] = '\0';
+    return result;
+}
+
+int energy_start(EnergyMeter *meter) {
+    meter->count = 0;
+    DIR *dir = opendir(POWERCAP_ROOT);
+    if (!dir) {
+        return 0;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) && meter->count < ENERGY_MAX_DOMAINS) {
+        // packages are intel-rapl:N, their parts intel-rapl:N:M - AMD
+        // cpus report through the same driver
+        if (strncmp(entry->d_name, "intel-rapl:", 11) != 0) {
+            continue;
+        }
+        char name[64];
+        if (read_name(entry->d_name, name, sizeof(name)) != 0) {
+            continue;
+        }
+        int dram = strcmp(name, "dram") == 0;
+        // core, uncore and psys overlap the package - leave them out
+        if (!dram && strncmp(name, "package", 7) != 0) {
+            continue;
+        }
+        EnergyDomain *domain = &meter->domains[meter->count];
+        snprintf(domain->path, sizeof(domain->path), "%s/%s/energy_uj", POWERCAP_ROOT,
+                 entry->d_name);
+        char range_path[320];
+        snprintf(range_path, sizeof(range_path), "%s/%s/max_energy_range_uj", POWERCAP_ROOT,
+                 entry->d_name);
+        if (read_counter(range_path, &domain->max_range) != 0) {
+            domain->max_range = 0;
+        }
+        // energy_uj is root only on most kernels since the RAPL side channel
+        if (read_counter(domain->path, &domain->start) != 0) {
+            continue;
+        }
+        domain->dram = dram;
+        meter->count++;
+    }
+    closedir(dir);
+    return meter->count;
+}
+
+void energy_stop(const EnergyMeter *meter, double *package_joules, double *dram_joules) {
+    *package_joules = *dram_joules = -1;
+    for (int i = 0; i < meter->count; i++) {
+        const EnergyDomain *domain = &meter->domains[i];
+        unsigned long long now;
+        if (read_counter(domain->path, &now) != 0) {
+            continue;
+        }
+        // at most one wrap - the counters take minutes to go round
+        unsigned long long used = now >= domain->start ? now - domain->start :
+                                  now + domain->max_range - domain->start;
+        double *total = domain->dram ? dram_joules : package_joules;
+        if (*total < 0) {
+            *total = 0;
+        }
+        *total += used / 1e6;
+    }
+}
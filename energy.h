@@ -0,0 +1,28 @@
+#ifndef ENERGY_H
+#define ENERGY_H
+
+// package and DRAM energy from the RAPL counters linux exposes under
+// /sys/class/powercap - absent on most VMs and non x86 machines, and
+// usually readable by root only, in which case there is nothing to report
+#define ENERGY_MAX_DOMAINS 16
+
+typedef struct {
+    char path[320]; // its energy_uj counter
+    int dram; // DRAM rather than a whole package
+    unsigned long long max_range; // the counter wraps after this many uJ
+    unsigned long long start;
+} EnergyDomain;
+
+typedef struct {
+    EnergyDomain domains[ENERGY_MAX_DOMAINS];
+    int count;
+} EnergyMeter;
+
+// find the readable package and DRAM counters and note where they stand -
+// 0 domains means energy can't be measured here
+int energy_start(EnergyMeter *meter);
+// joules used since energy_start, summed over all packages / DRAM domains
+// (-1 where the machine has none)
+void energy_stop(const EnergyMeter *meter, double *package_joules, double *dram_joules);
+
+#endif
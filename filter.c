@@ -0,0 +1,381 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "cpu.h"
+#include "filter.h"
+#ifdef CPU_X86
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+int parse_filter(const char *spec, FilterConfig *filter) {
+    const char *colon = strchr(spec, ':');
+    size_t name_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    int param = colon ? atoi(colon + 1) : 0;
+    if (name_len == 5 && strncmp(spec, "delta", 5) == 0) {
+        filter->id = FILTER_DELTA;
+        filter->param = colon ? param : 1;
+    } else if (name_len == 9 && strncmp(spec, "transpose", 9) == 0) {
+        filter->id = FILTER_TRANSPOSE;
+        filter->param = colon ? param : 4;
+    } else if (name_len == 3 && strncmp(spec, "bcj", 3) == 0 && !colon) {
+        filter->id = FILTER_BCJ;
+        filter->param = 0;
+        return 0;
+    } else if (name_len == 3 && strncmp(spec, "log", 3) == 0 && !colon) {
+        filter->id = FILTER_LOG;
+        filter->param = 0;
+        return 0;
+    } else {
+        fprintf(stderr, "Unknown filter '%s'\n", spec);
+        return -1;
+    }
+    // the parameter travels in one byte of the block header 
+    if (filter->param < 1 || filter->param > 255 || 
+        (filter->id == FILTER_TRANSPOSE && filter->param < 2)) {
+        fprintf(stderr, "Bad filter parameter in '%s'\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+const char *filter_name(FilterId id) {
+    switch (id) {
+        case FILTER_DELTA: return "delta";
+        case FILTER_TRANSPOSE: return "transpose";
+        case FILTER_BCJ: return "bcj";
+        case FILTER_LONG_RANGE: return "long-range";
+        case FILTER_LOG: return "log";
+        default: return "none";
+    }
+}
+
+// ---- delta ---- 
+
+#if defined(CPU_X86) && defined(__SSE2__)
+__attribute__((target("avx2")))
+static unsigned int delta_encode_avx2(const unsigned char *in, unsigned char *out, 
+                                      unsigned int i, unsigned int size, unsigned int stride) {
+    for (; i + 32 <= size; i += 32) {
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(in + i));
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(in + i - stride));
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_sub_epi8(cur, prev));
+    }
+    return i;
+}
+#endif
+
+static void delta_encode(const unsigned char *in, unsigned char *out, unsigned int size, 
+                         unsigned int stride) {
+    unsigned int i = 0;
+    for (; i < stride && i < size; i++) {
+        out[i] = in[i];
+    }
+#ifdef __SSE2__
+    // every output byte only depends on input, so any stride vectorizes 
+    CpuLevel level = cpu_level();
+#ifdef CPU_X86
+    if (level >= CPU_AVX2) {
+        i = delta_encode_avx2(in, out, i, size, stride);
+    }
+#endif
+    for (; level >= CPU_SSE2 && i + 16 <= size; i += 16) {
+        __m128i cur = _mm_loadu_si128((const __m128i *)(in + i));
+        __m128i prev = _mm_loadu_si128((const __m128i *)(in + i - stride));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_sub_epi8(cur, prev));
+    }
+#endif
+    for (; i < size; i++) {
+        out[i] = in[i] - in[i - stride];
+    }
+}
+
+#ifdef __SSE2__
+// running sum of every stride-th byte inside one vector, plus the last 
+// stride bytes of the previous vector - strides 1, 2, 4 and 8 
+#define DELTA_PREFIX(x, s) do { \
+        if ((s) < 16) (x) = _mm_add_epi8((x), _mm_slli_si128((x), (s))); \
+        if (2 * (s) < 16) (x) = _mm_add_epi8((x), _mm_slli_si128((x), 2 * (s))); \
+        if (4 * (s) < 16) (x) = _mm_add_epi8((x), _mm_slli_si128((x), 4 * (s))); \
+        if (8 * (s) < 16) (x) = _mm_add_epi8((x), _mm_slli_si128((x), 8 * (s))); \
+    } while (0)
+
+// last s bytes of v repeated across the register 
+static inline __m128i delta_carry(__m128i v, unsigned int s) {
+    switch (s) {
+        case 1:
+            v = _mm_unpackhi_epi8(v, v);
+            /* fall through */
+        case 2:
+            v = _mm_shufflehi_epi16(v, 0xFF);
+            return _mm_shuffle_epi32(v, 0xFF);
+        case 4:
+            return _mm_shuffle_epi32(v, 0xFF);
+        default:
+            return _mm_unpackhi_epi64(v, v);
+    }
+}
+#endif
+
+static void delta_decode(const unsigned char *in, unsigned char *out, unsigned int size, 
+                         unsigned int stride) {
+    unsigned int i = 0;
+    for (; i < stride && i < size; i++) {
+        out[i] = in[i];
+    }
+#ifdef __SSE2__
+    // the prefix sums stay 16 wide - across 32 byte lanes they cost more 
+    // shuffles than they save 
+    if (cpu_level() < CPU_SSE2) {
+        // generic run below 
+    } else if (stride >= 16) {
+        // a whole vector back is already decoded 
+        for (; i + 16 <= size; i += 16) {
+            __m128i cur = _mm_loadu_si128((const __m128i *)(in + i));
+            __m128i prev = _mm_loadu_si128((const __m128i *)(out + i - stride));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi8(cur, prev));
+        }
+    } else if (stride == 1 || stride == 2 || stride == 4 || stride == 8) {
+        // short strides are a prefix sum within the vector 
+        if (i < 16 && size >= 16) {
+            for (; i < 16; i++) {
+                out[i] = in[i] + out[i - stride];
+            }
+        }
+        for (; i + 16 <= size; i += 16) {
+            __m128i x = _mm_loadu_si128((const __m128i *)(in + i));
+            switch (stride) {
+                case 1: DELTA_PREFIX(x, 1); break;
+                case 2: DELTA_PREFIX(x, 2); break;
+                case 4: DELTA_PREFIX(x, 4); break;
+                default: DELTA_PREFIX(x, 8); break;
+            }
+            __m128i prev = _mm_loadu_si128((const __m128i *)(out + i - 16));
+            _mm_storeu_si128((__m128i *)(out + i), _mm_add_epi8(x, delta_carry(prev, stride)));
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        out[i] = in[i] + out[i - stride];
+    }
+}
+
+// ---- byte plane transpose ---- 
+
+#ifdef __SSE2__
+// even bytes of a then b, and odd bytes of a then b 
+static inline void split_bytes(__m128i a, __m128i b, __m128i *even, __m128i *odd) {
+    __m128i mask = _mm_set1_epi16(0x00FF);
+    *even = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+    *odd = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+}
+
+// 16 records of width bytes -> width planes of 16 bytes, by repeatedly 
+// splitting even and odd bytes (width is 2, 4 or 8) 
+static void transpose_16_records(const unsigned char *in, unsigned char *out, 
+                                 unsigned int width, unsigned int plane_size) {
+    __m128i v[8], next[8];
+    for (unsigned int j = 0; j < width; j++) {
+        v[j] = _mm_loadu_si128((const __m128i *)(in + 16 * j));
+    }
+    for (unsigned int round = 1; round < width; round <<= 1) {
+        for (unsigned int j = 0; j < width / 2; j++) {
+            split_bytes(v[2 * j], v[2 * j + 1], &next[j], &next[width / 2 + j]);
+        }
+        memcpy(v, next, width * sizeof(__m128i));
+    }
+    for (unsigned int p = 0; p < width; p++) {
+        _mm_storeu_si128((__m128i *)(out + (size_t)p * plane_size), v[p]);
+    }
+}
+
+// and back, interleaving instead of splitting 
+static void untranspose_16_records(const unsigned char *in, unsigned char *out, 
+                                   unsigned int width, unsigned int plane_size) {
+    __m128i v[8], next[8];
+    for (unsigned int p = 0; p < width; p++) {
+        v[p] = _mm_loadu_si128((const __m128i *)(in + (size_t)p * plane_size));
+    }
+    for (unsigned int round = 1; round < width; round <<= 1) {
+        for (unsigned int j = 0; j < width / 2; j++) {
+            next[2 * j] = _mm_unpacklo_epi8(v[j], v[width / 2 + j]);
+            next[2 * j + 1] = _mm_unpackhi_epi8(v[j], v[width / 2 + j]);
+        }
+        memcpy(v, next, width * sizeof(__m128i));
+    }
+    for (unsigned int j = 0; j < width; j++) {
+        _mm_storeu_si128((__m128i *)(out + 16 * j), v[j]);
+    }
+}
+#endif
+
+static void transpose(const unsigned char *in, unsigned char *out, unsigned int size, 
+                      unsigned int width, int encode) {
+    unsigned int records = size / width;
+    unsigned int r = 0;
+#ifdef __SSE2__
+    if (cpu_level() >= CPU_SSE2 && (width == 2 || width == 4 || width == 8)) {
+        for (; r + 16 <= records; r += 16) {
+            if (encode) {
+                transpose_16_records(in + (size_t)r * width, out + r, width, records);
+            } else {
+                untranspose_16_records(in + r, out + (size_t)r * width, width, records);
+            }
+        }
+    }
+#endif
+    for (; r < records; r++) {
+        for (unsigned int p = 0; p < width; p++) {
+            if (encode) {
+                out[(size_t)p * records + r] = in[(size_t)r * width + p];
+            } else {
+                out[(size_t)r * width + p] = in[(size_t)p * records + r];
+            }
+        }
+    }
+    // a partial record at the end stays as it is 
+    memcpy(out + (size_t)records * width, in + (size_t)records * width, size - records * width);
+}
+
+// ---- x86 branch/call ---- 
+
+// next E8 (call) or E9 (jmp) opcode at or after i - E8 and E9 only differ 
+// in the low bit, so the vector kernels compare with it set 
+typedef unsigned int (*BranchScan)(const unsigned char *p, unsigned int i, unsigned int end);
+
+static unsigned int branch_generic(const unsigned char *p, unsigned int i, unsigned int end) {
+    for (; i < end; i++) {
+        if ((p[i] & 0xFE) == 0xE8) {
+            return i;
+        }
+    }
+    return end;
+}
+
+#ifdef __SSE2__
+static unsigned int branch_sse2(const unsigned char *p, unsigned int i, unsigned int end) {
+    const __m128i low = _mm_set1_epi8(1);
+    const __m128i branch = _mm_set1_epi8((char)0xE9);
+    for (; i + 16 <= end; i += 16) {
+        __m128i v = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + i)), low);
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, branch));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return branch_generic(p, i, end);
+}
+#else
+#define branch_sse2 branch_generic
+#endif
+
+#ifdef CPU_X86
+__attribute__((target("avx2")))
+static unsigned int branch_avx2(const unsigned char *p, unsigned int i, unsigned int end) {
+    const __m256i low = _mm256_set1_epi8(1);
+    const __m256i branch = _mm256_set1_epi8((char)0xE9);
+    for (; i + 32 <= end; i += 32) {
+        __m256i v = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + i)), low);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, branch));
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return branch_generic(p, i, end);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static unsigned int branch_avx512(const unsigned char *p, unsigned int i, unsigned int end) {
+    const __m512i low = _mm512_set1_epi8(1);
+    const __m512i branch = _mm512_set1_epi8((char)0xE9);
+    for (; i + 64 <= end; i += 64) {
+        __m512i v = _mm512_or_si512(_mm512_loadu_si512(p + i), low);
+        uint64_t mask = _mm512_cmpeq_epi8_mask(v, branch);
+        if (mask) {
+            return i + __builtin_ctzll(mask);
+        }
+    }
+    return branch_generic(p, i, end);
+}
+#else
+#define branch_avx2 branch_sse2
+#define branch_avx512 branch_sse2
+#endif
+
+static const BranchScan branch_kernels[CPU_LEVELS] = {
+    branch_generic, branch_sse2, branch_avx2, branch_avx512
+};
+
+// rel32 operands whose top byte is 00 or FF are treated as 25 bit signed 
+// values and turned into position + offset (mod 2^25), keeping the top 
+// byte 00/FF - so decode sees the same candidates and the mapping is 
+// exactly reversible. a rejected candidate also skips the next 3 bytes, 
+// otherwise a later conversion could rewrite the byte it was judged on 
+static void bcj(unsigned char *buf, unsigned int size, int encode) {
+    if (size < 5) {
+        return;
+    }
+    unsigned int end = size - 4;
+    unsigned int i = 0;
+    BranchScan next_branch = branch_kernels[cpu_level()];
+    while ((i = next_branch(buf, i, end)) < end) {
+        unsigned char top = buf[i + 4];
+        if (top != 0x00 && top != 0xFF) {
+            i += 4;
+            continue;
+        }
+        uint32_t value = buf[i + 1] | buf[i + 2] << 8 | buf[i + 3] << 16 | (uint32_t)top << 24;
+        uint32_t position = i + 5;
+        uint32_t converted = encode ? value + position : value - position;
+        // sign extend from bit 24 
+        converted &= 0x1FFFFFF;
+        if (converted & 0x1000000) {
+            converted |= 0xFE000000;
+        }
+        buf[i + 1] = converted;
+        buf[i + 2] = converted >> 8;
+        buf[i + 3] = converted >> 16;
+        buf[i + 4] = converted >> 24;
+        i += 5;
+    }
+}
+
+void filter_encode(const FilterConfig *filter, const unsigned char *in, 
+                   unsigned char *out, unsigned int size) {
+    switch (filter->id) {
+        case FILTER_DELTA:
+            delta_encode(in, out, size, filter->param);
+            break;
+        case FILTER_TRANSPOSE:
+            transpose(in, out, size, filter->param, 1);
+            break;
+        case FILTER_BCJ:
+            memcpy(out, in, size);
+            bcj(out, size, 1);
+            break;
+        default:
+            memcpy(out, in, size);
+            break;
+    }
+}
+
+void filter_decode(const FilterConfig *filter, const unsigned char *in, 
+                   unsigned char *out, unsigned int size) {
+    switch (filter->id) {
+        case FILTER_DELTA:
+            delta_decode(in, out, size, filter->param);
+            break;
+        case FILTER_TRANSPOSE:
+            transpose(in, out, size, filter->param, 0);
+            break;
+        case FILTER_BCJ:
+            memcpy(out, in, size);
+            bcj(out, size, 0);
+            break;
+        default:
+            memcpy(out, in, size);
+            break;
+    }
+}
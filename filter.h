@@ -0,0 +1,30 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+// reversible transforms applied to a block before it is compressed - the
+// filter and its parameter are recorded in the container block header
+typedef enum {
+    FILTER_NONE = 0,
+    FILTER_DELTA = 1, // byte minus the byte param positions back
+    FILTER_TRANSPOSE = 2, // param byte records split into byte planes
+    FILTER_BCJ = 3, // x86 call/jmp targets made absolute
+    FILTER_LONG_RANGE = 4, // long range tokens, expanded in block order (see longrange.h)
+    FILTER_LOG = 5 // lines split into templates and variable columns (see logtemplate.h)
+} FilterId;
+
+typedef struct {
+    FilterId id;
+    int param;
+} FilterConfig;
+
+// "delta[:stride]", "transpose[:width]", "bcj" or "log"
+int parse_filter(const char *spec, FilterConfig *filter);
+const char *filter_name(FilterId id);
+// out and in are size bytes and must not overlap - not for the log filter, 
+// which changes the size of the block
+void filter_encode(const FilterConfig *filter, const unsigned char *in, 
+                   unsigned char *out, unsigned int size);
+void filter_decode(const FilterConfig *filter, const unsigned char *in, 
+                   unsigned char *out, unsigned int size);
+
+#endif
@@ -0,0 +1,543 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "container.h"
+#include "cpu.h"
+#include "huffman.h"
+
+// refinement passes over the selectors, as in bzip2 
+#define FULL_ITERATIONS 4
+// histograms closer than this (total variation distance) count as the same 
+// statistics in fast mode 
+#define CLOSE_DISTANCE 0.08
+
+// ---- bits ---- 
+
+typedef struct {
+    uint64_t bits;
+    int count;
+    unsigned char *out;
+    unsigned char *end;
+    int overflow;
+} BitWriter;
+
+static inline void put_bits(BitWriter *w, int n, uint32_t value) {
+    w->bits = (w->bits << n) | value;
+    w->count += n;
+    while (w->count >= 8) {
+        w->count -= 8;
+        if (w->out == w->end) {
+            w->overflow = 1;
+            return;
+        }
+        *w->out++ = w->bits >> w->count;
+    }
+}
+
+static void flush_bits(BitWriter *w) {
+    if (w->count > 0) {
+        put_bits(w, 8 - w->count, 0);
+    }
+}
+
+typedef struct {
+    uint64_t bits;
+    int count;
+    const unsigned char *in;
+    const unsigned char *end;
+} BitReader;
+
+static inline void refill(BitReader *r) {
+    // past the end reads zeros - counts and lengths are checked instead 
+    while (r->count <= 56) {
+        r->bits |= (uint64_t)(r->in < r->end ? *r->in++ : 0) << (56 - r->count);
+        r->count += 8;
+    }
+}
+
+// top n bits without consuming them 
+static inline uint32_t peek_bits(BitReader *r, int n) {
+    return r->bits >> (64 - n);
+}
+
+static inline void skip_bits(BitReader *r, int n) {
+    r->bits <<= n;
+    r->count -= n;
+}
+
+static inline uint32_t get_bits(BitReader *r, int n) {
+    refill(r);
+    uint32_t value = peek_bits(r, n);
+    skip_bits(r, n);
+    return value;
+}
+
+// ---- code lengths ---- 
+
+// huffman code lengths limited to max_length - when the tree is too deep 
+// the weights are flattened and it is built again 
+static void make_lengths(unsigned char *lengths, const unsigned int *freq, int alphabet, 
+                         int max_length) {
+    // node weights carry the depth of their subtree in the low 8 bits 
+    unsigned int weight[HUFF_ALPHABET * 2];
+    int parent[HUFF_ALPHABET * 2];
+    int heap[HUFF_ALPHABET + 2];
+    for (int i = 0; i < alphabet; i++) {
+        weight[i + 1] = (freq[i] ? freq[i] : 1) << 8;
+    }
+    for (;;) {
+        int nodes = alphabet;
+        int heap_size = 0;
+        heap[0] = 0;
+        weight[0] = 0;
+        parent[0] = -2;
+        for (int i = 1; i <= alphabet; i++) {
+            parent[i] = -1;
+            // sift up 
+            int at = ++heap_size;
+            while (weight[i] < weight[heap[at >> 1]]) {
+                heap[at] = heap[at >> 1];
+                at >>= 1;
+            }
+            heap[at] = i;
+        }
+        while (heap_size > 1) {
+            int pair[2];
+            for (int k = 0; k < 2; k++) {
+                pair[k] = heap[1];
+                heap[1] = heap[heap_size--];
+                // sift down 
+                int at = 1;
+                int item = heap[1];
+                for (;;) {
+                    int child = at << 1;
+                    if (child > heap_size) {
+                        break;
+                    }
+                    if (child < heap_size && weight[heap[child + 1]] < weight[heap[child]]) {
+                        child++;
+                    }
+                    if (weight[item] < weight[heap[child]]) {
+                        break;
+                    }
+                    heap[at] = heap[child];
+                    at = child;
+                }
+                heap[at] = item;
+            }
+            nodes++;
+            parent[pair[0]] = parent[pair[1]] = nodes;
+            unsigned int depth_a = weight[pair[0]] & 0xFF;
+            unsigned int depth_b = weight[pair[1]] & 0xFF;
+            weight[nodes] = ((weight[pair[0]] & ~0xFFU) + (weight[pair[1]] & ~0xFFU)) | 
+                            (1 + (depth_a > depth_b ? depth_a : depth_b));
+            parent[nodes] = -1;
+            int at = ++heap_size;
+            while (weight[nodes] < weight[heap[at >> 1]]) {
+                heap[at] = heap[at >> 1];
+                at >>= 1;
+            }
+            heap[at] = nodes;
+        }
+        int too_long = 0;
+        for (int i = 1; i <= alphabet; i++) {
+            int depth = 0;
+            for (int k = i; parent[k] >= 0; k = parent[k]) {
+                depth++;
+            }
+            lengths[i - 1] = depth;
+            too_long |= depth > max_length;
+        }
+        if (!too_long) {
+            return;
+        }
+        for (int i = 1; i <= alphabet; i++) {
+            weight[i] = (1 + (weight[i] >> 8) / 2) << 8;
+        }
+    }
+}
+
+// canonical codes - shorter codes first, symbol order within a length 
+static void assign_codes(uint32_t *codes, const unsigned char *lengths, int alphabet) {
+    uint32_t code = 0;
+    for (int length = 1; length <= HUFF_MAX_LENGTH; length++) {
+        for (int s = 0; s < alphabet; s++) {
+            if (lengths[s] == length) {
+                codes[s] = code++;
+            }
+        }
+        code <<= 1;
+    }
+}
+
+// ---- table selection ---- 
+
+typedef struct {
+    int tables;
+    unsigned char lengths[HUFF_MAX_TABLES][HUFF_ALPHABET];
+    unsigned int freq[HUFF_ALPHABET]; // histogram of the block that built them
+    unsigned int count;
+} TableSeed;
+
+// what this thread's previous block ended up with 
+static __thread TableSeed *previous;
+
+static int table_count(unsigned int symbols) {
+    return symbols < 200 ? 2 : symbols < 600 ? 3 : symbols < 1200 ? 4 : 
+           symbols < 2400 ? 5 : 6;
+}
+
+// bzip2's starting point: split the alphabet into bands of equal total 
+// frequency, each table cheap inside its band and dear outside it 
+static void initial_tables(unsigned char lengths[][HUFF_ALPHABET], int tables, 
+                           const unsigned int *freq, unsigned int count) {
+    int low = 0;
+    unsigned int remaining = count;
+    for (int t = tables; t > 0; t--) {
+        unsigned int target = remaining / t;
+        unsigned int sum = 0;
+        int high = low - 1;
+        while (sum < target && high < HUFF_ALPHABET - 1) {
+            sum += freq[++high];
+        }
+        if (high > low && t != tables && t != 1 && ((tables - t) % 2 == 1)) {
+            sum -= freq[high--];
+        }
+        for (int s = 0; s < HUFF_ALPHABET; s++) {
+            lengths[tables - t][s] = s >= low && s <= high ? 0 : 15;
+        }
+        low = high + 1;
+        remaining -= sum;
+    }
+}
+
+// how far apart two histograms are, 0 (same) to 1 (disjoint) 
+static double distance(const unsigned int *a, unsigned int a_count, const unsigned int *b, 
+                       unsigned int b_count) {
+    double total = 0;
+    for (int s = 0; s < HUFF_ALPHABET; s++) {
+        double d = (double)a[s] / a_count - (double)b[s] / b_count;
+        total += d < 0 ? -d : d;
+    }
+    return total / 2;
+}
+
+// cost of one group under every table - the hot loop of the encoder 
+// every table's length for a symbol side by side, so one 16 byte load has 
+// what that symbol costs under all of them 
+typedef uint16_t PackedLengths[HUFF_ALPHABET][8];
+
+static void pack_lengths(PackedLengths packed, unsigned char lengths[][HUFF_ALPHABET], 
+                         int tables) {
+    memset(packed, 0, sizeof(PackedLengths));
+    for (int t = 0; t < tables; t++) {
+        for (int s = 0; s < HUFF_ALPHABET; s++) {
+            packed[s][t] = lengths[t][s];
+        }
+    }
+}
+
+typedef void (*GroupCosts)(const uint16_t *symbols, unsigned int n, 
+                           const PackedLengths packed, int tables, unsigned int *cost);
+
+static void group_costs_generic(const uint16_t *symbols, unsigned int n, 
+                                const PackedLengths packed, int tables, unsigned int *cost) {
+    for (int t = 0; t < tables; t++) {
+        cost[t] = 0;
+    }
+    for (unsigned int i = 0; i < n; i++) {
+        for (int t = 0; t < tables; t++) {
+            cost[t] += packed[symbols[i]][t];
+        }
+    }
+}
+
+#ifdef __SSE2__
+// a group is at most 50 symbols of at most 17 bits, so 16 bit lanes can't 
+// overflow. all 8 tables fit one register, so wider vectors gain nothing 
+static void group_costs_sse2(const uint16_t *symbols, unsigned int n, 
+                             const PackedLengths packed, int tables, unsigned int *cost) {
+    __m128i even = _mm_setzero_si128();
+    __m128i odd = _mm_setzero_si128();
+    unsigned int i = 0;
+    for (; i + 2 <= n; i += 2) {
+        even = _mm_add_epi16(even, _mm_loadu_si128((const __m128i *)packed[symbols[i]]));
+        odd = _mm_add_epi16(odd, _mm_loadu_si128((const __m128i *)packed[symbols[i + 1]]));
+    }
+    if (i < n) {
+        even = _mm_add_epi16(even, _mm_loadu_si128((const __m128i *)packed[symbols[i]]));
+    }
+    uint16_t lanes[8];
+    _mm_storeu_si128((__m128i *)lanes, _mm_add_epi16(even, odd));
+    for (int t = 0; t < tables; t++) {
+        cost[t] = lanes[t];
+    }
+}
+#endif
+
+static GroupCosts pick_group_costs(void) {
+#ifdef __SSE2__
+    if (cpu_level() >= CPU_SSE2) {
+        return group_costs_sse2;
+    }
+#endif
+    return group_costs_generic;
+}
+
+long huffman_encode(const uint16_t *symbols, unsigned int count, unsigned char *out, 
+                    unsigned int capacity, int fast) {
+    if (capacity < 9) {
+        return -1;
+    }
+    unsigned int groups = (count + HUFF_GROUP - 1) / HUFF_GROUP;
+    unsigned char *selectors = malloc(groups ? groups : 1);
+    TableSeed *seed = malloc(sizeof(TableSeed));
+    if (!selectors || !seed) {
+        free(selectors);
+        free(seed);
+        return -1;
+    }
+    memset(seed->freq, 0, sizeof(seed->freq));
+    for (unsigned int i = 0; i < count; i++) {
+        seed->freq[symbols[i]]++;
+    }
+    seed->count = count;
+    seed->tables = table_count(count);
+    // fast mode starts from the tables that worked for the last block 
+    int iterations = FULL_ITERATIONS;
+    if (fast && previous && previous->tables == seed->tables && count > 0) {
+        memcpy(seed->lengths, previous->lengths, sizeof(seed->lengths));
+        iterations = distance(seed->freq, count, previous->freq, previous->count) < 
+                     CLOSE_DISTANCE ? 1 : 2;
+    } else {
+        initial_tables(seed->lengths, seed->tables, seed->freq, count);
+    }
+    int tables = seed->tables;
+    GroupCosts group_costs = pick_group_costs();
+    for (int pass = 0; pass < iterations; pass++) {
+        unsigned int table_freq[HUFF_MAX_TABLES][HUFF_ALPHABET];
+        memset(table_freq, 0, sizeof(table_freq));
+        PackedLengths packed;
+        pack_lengths(packed, seed->lengths, tables);
+        for (unsigned int g = 0; g < groups; g++) {
+            unsigned int start = g * HUFF_GROUP;
+            unsigned int n = count - start < HUFF_GROUP ? count - start : HUFF_GROUP;
+            unsigned int cost[HUFF_MAX_TABLES];
+            group_costs(symbols + start, n, packed, tables, cost);
+            int best = 0;
+            for (int t = 1; t < tables; t++) {
+                if (cost[t] < cost[best]) {
+                    best = t;
+                }
+            }
+            selectors[g] = best;
+            for (unsigned int i = 0; i < n; i++) {
+                table_freq[best][symbols[start + i]]++;
+            }
+        }
+        for (int t = 0; t < tables; t++) {
+            make_lengths(seed->lengths[t], table_freq[t], HUFF_ALPHABET, HUFF_MAX_LENGTH);
+        }
+    }
+    put_u32(out, count);
+    out[4] = tables;
+    put_u32(out + 5, groups);
+    BitWriter w = {0, 0, out + 9, out + capacity, 0};
+    // selectors, move-to-front then unary 
+    unsigned char order[HUFF_MAX_TABLES];
+    for (int t = 0; t < tables; t++) {
+        order[t] = t;
+    }
+    for (unsigned int g = 0; g < groups; g++) {
+        int rank = 0;
+        while (order[rank] != selectors[g]) {
+            rank++;
+        }
+        memmove(order + 1, order, rank);
+        order[0] = selectors[g];
+        put_bits(&w, rank + 1, ((1U << rank) - 1) << 1);
+    }
+    // code lengths, each as a walk from the previous one 
+    uint32_t codes[HUFF_MAX_TABLES][HUFF_ALPHABET];
+    for (int t = 0; t < tables; t++) {
+        int current = seed->lengths[t][0];
+        put_bits(&w, 5, current);
+        for (int s = 0; s < HUFF_ALPHABET; s++) {
+            while (current < seed->lengths[t][s]) {
+                put_bits(&w, 2, 2);
+                current++;
+            }
+            while (current > seed->lengths[t][s]) {
+                put_bits(&w, 2, 3);
+                current--;
+            }
+            put_bits(&w, 1, 0);
+        }
+        assign_codes(codes[t], seed->lengths[t], HUFF_ALPHABET);
+    }
+    for (unsigned int g = 0; g < groups && !w.overflow; g++) {
+        int t = selectors[g];
+        unsigned int end = (g + 1) * HUFF_GROUP < count ? (g + 1) * HUFF_GROUP : count;
+        for (unsigned int i = g * HUFF_GROUP; i < end; i++) {
+            put_bits(&w, seed->lengths[t][symbols[i]], codes[t][symbols[i]]);
+        }
+    }
+    flush_bits(&w);
+    free(selectors);
+    // keep this block's tables for the next one 
+    free(previous);
+    previous = seed;
+    return w.overflow ? -1 : w.out - out;
+}
+
+void huffman_thread_cleanup(void) {
+    free(previous);
+    previous = NULL;
+}
+
+// ---- decoding ---- 
+
+// one lookup for codes up to FAST_BITS long, a canonical walk past that 
+#define FAST_BITS 10
+
+typedef struct {
+    uint16_t fast[1 << FAST_BITS]; // symbol << 5 | length, 0 when longer
+    uint32_t limit[HUFF_MAX_LENGTH + 2]; // first code past each length, left aligned
+    int base[HUFF_MAX_LENGTH + 2]; // index of each length's first code in sorted
+    uint32_t first[HUFF_MAX_LENGTH + 2];
+    uint16_t sorted[HUFF_ALPHABET];
+} DecodeTable;
+
+static int build_decoder(DecodeTable *d, const unsigned char *lengths) {
+    // the lengths come from the archive - over-full ones (the kraft sum 
+    // past 1) would place codes beyond the fast table, so refuse them first 
+    unsigned int per_length[HUFF_MAX_LENGTH + 1] = {0};
+    for (int s = 0; s < HUFF_ALPHABET; s++) {
+        per_length[lengths[s]]++;
+    }
+    uint32_t room = 0;
+    for (int length = 1; length <= HUFF_MAX_LENGTH; length++) {
+        room = (room << 1) + per_length[length];
+        if (room > (1U << length)) {
+            return -1;
+        }
+    }
+    uint32_t codes[HUFF_ALPHABET];
+    assign_codes(codes, lengths, HUFF_ALPHABET);
+    memset(d->fast, 0, sizeof(d->fast));
+    int n = 0;
+    uint32_t code = 0;
+    for (int length = 1; length <= HUFF_MAX_LENGTH; length++) {
+        d->base[length] = n;
+        d->first[length] = code;
+        for (int s = 0; s < HUFF_ALPHABET; s++) {
+            if (lengths[s] != length) {
+                continue;
+            }
+            d->sorted[n++] = s;
+            code++;
+            if (length <= FAST_BITS) {
+                uint32_t start = codes[s] << (FAST_BITS - length);
+                for (uint32_t k = 0; k < (1U << (FAST_BITS - length)); k++) {
+                    d->fast[start + k] = s << 5 | length;
+                }
+            }
+        }
+        d->limit[length] = code;
+        code <<= 1;
+    }
+    return 0;
+}
+
+static inline int decode_symbol(BitReader *r, const DecodeTable *d) {
+    refill(r);
+    uint16_t entry = d->fast[peek_bits(r, FAST_BITS)];
+    if (entry) {
+        skip_bits(r, entry & 31);
+        return entry >> 5;
+    }
+    for (int length = FAST_BITS + 1; length <= HUFF_MAX_LENGTH; length++) {
+        uint32_t code = peek_bits(r, length);
+        if (code < d->limit[length]) {
+            skip_bits(r, length);
+            return d->sorted[d->base[length] + code - d->first[length]];
+        }
+    }
+    return -1;
+}
+
+long huffman_decode(const unsigned char *in, unsigned int size, uint16_t *symbols, 
+                    unsigned int max_symbols) {
+    if (size < 9) {
+        return -1;
+    }
+    unsigned int count = get_u32(in);
+    int tables = in[4];
+    unsigned int groups = get_u32(in + 5);
+    if (count > max_symbols || tables < 2 || tables > HUFF_MAX_TABLES || 
+        groups != (count + HUFF_GROUP - 1) / HUFF_GROUP) {
+        return -1;
+    }
+    unsigned char *selectors = malloc(groups ? groups : 1);
+    DecodeTable *decoders = malloc(tables * sizeof(DecodeTable));
+    long result = selectors && decoders ? (long)count : -1;
+    BitReader r = {0, 0, in + 9, in + size};
+    unsigned char order[HUFF_MAX_TABLES];
+    for (int t = 0; t < tables; t++) {
+        order[t] = t;
+    }
+    for (unsigned int g = 0; g < groups && result >= 0; g++) {
+        int rank = 0;
+        while (get_bits(&r, 1) && rank < tables) {
+            rank++;
+        }
+        // a run past the last table is corrupt - stop before indexing order 
+        if (rank >= tables) {
+            result = -1;
+            break;
+        }
+        unsigned char t = order[rank];
+        memmove(order + 1, order, rank);
+        order[0] = t;
+        selectors[g] = t;
+    }
+    for (int t = 0; t < tables && result >= 0; t++) {
+        unsigned char lengths[HUFF_ALPHABET];
+        int current = get_bits(&r, 5);
+        if (current < 1 || current > HUFF_MAX_LENGTH) {
+            result = -1;
+            break;
+        }
+        for (int s = 0; s < HUFF_ALPHABET && result >= 0; s++) {
+            while (get_bits(&r, 1)) {
+                current += get_bits(&r, 1) ? -1 : 1;
+                if (current < 1 || current > HUFF_MAX_LENGTH) {
+                    result = -1;
+                    break;
+                }
+            }
+            lengths[s] = current;
+        }
+        if (result >= 0 && build_decoder(&decoders[t], lengths) != 0) {
+            result = -1;
+        }
+    }
+    for (unsigned int g = 0; g < groups && result >= 0; g++) {
+        const DecodeTable *d = &decoders[selectors[g]];
+        unsigned int end = (g + 1) * HUFF_GROUP < count ? (g + 1) * HUFF_GROUP : count;
+        for (unsigned int i = g * HUFF_GROUP; i < end; i++) {
+            int symbol = decode_symbol(&r, d);
+            if (symbol < 0) {
+                result = -1;
+                break;
+            }
+            symbols[i] = symbol;
+        }
+    }
+    free(selectors);
+    free(decoders);
+    return result;
+}
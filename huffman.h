@@ -0,0 +1,33 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <stdint.h>
+
+// bzip2 style entropy stage for the bwt codec: move-to-front ranks with 
+// zero runs written as RUNA/RUNB digits, coded with up to 6 huffman tables 
+// that are switched every 50 symbols. the payload is 
+//   u32 symbols u8 tables u32 selectors, then a bit stream of the 
+//   selectors (move-to-front, unary), the code lengths (delta coded) and 
+//   the symbols 
+#define HUFF_RUNA 0
+#define HUFF_RUNB 1
+// RUNA, RUNB and ranks 1..255 as rank + 1 
+#define HUFF_ALPHABET 257
+#define HUFF_MAX_TABLES 6
+#define HUFF_GROUP 50
+#define HUFF_MAX_LENGTH 17
+
+// fast mode seeds the tables from the previous block this thread coded and 
+// refines them less when the symbol statistics barely moved - which block 
+// that is depends on scheduling, so fast output is not reproducible across 
+// runs or thread counts. returns the payload size, or -1 when it does not 
+// fit in capacity 
+long huffman_encode(const uint16_t *symbols, unsigned int count, unsigned char *out, 
+                    unsigned int capacity, int fast);
+// returns the number of symbols, or -1 on a corrupt payload 
+long huffman_decode(const unsigned char *in, unsigned int size, uint16_t *symbols, 
+                    unsigned int max_symbols);
+// frees the fast mode seed the calling thread kept 
+void huffman_thread_cleanup(void);
+
+#endif
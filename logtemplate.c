@@ -0,0 +1,547 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "container.h"
+#include "logtemplate.h"
+
+#define SLOT_MARK 1
+
+typedef struct {
+    unsigned int start; // offset of the variable in the block
+    unsigned int length;
+} Span;
+
+typedef struct {
+    unsigned int offset; // into the template buffer
+    unsigned int length;
+    unsigned int slots;
+    unsigned int first_line; // lines using this template, chained through next_line
+    unsigned int last_line;
+} Template;
+
+typedef struct {
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+static int buffer_put(Buffer *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) {
+            capacity *= 2;
+        }
+        unsigned char *grown = realloc(buffer->data, capacity);
+        if (!grown) {
+            return -1;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return 0;
+}
+
+static int buffer_byte(Buffer *buffer, unsigned char byte) {
+    return buffer_put(buffer, &byte, 1);
+}
+
+static int buffer_varint(Buffer *buffer, unsigned int value) {
+    while (value >= 0x80) {
+        if (buffer_byte(buffer, (unsigned char)value | 0x80) != 0) {
+            return -1;
+        }
+        value >>= 7;
+    }
+    return buffer_byte(buffer, value);
+}
+
+// letters, digits and the punctuation found inside numbers, times, 
+// addresses and paths 
+static int is_word(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || 
+           c == '.' || c == ':' || c == '-' || c == '_' || c == '/';
+}
+
+static uint64_t hash_bytes(const unsigned char *p, size_t size) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ p[i]) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+unsigned char *log_template_encode(const unsigned char *in, unsigned int size, 
+                                   unsigned int *out_size) {
+    if (size == 0) {
+        return NULL;
+    }
+    unsigned int max_lines = 1;
+    for (unsigned int i = 0; i < size; i++) {
+        max_lines += in[i] == '\n';
+    }
+    // per line: template, and where its variables start in spans 
+    unsigned int *line_template = malloc(max_lines * sizeof(unsigned int));
+    unsigned int *line_span = malloc((max_lines + 1) * sizeof(unsigned int));
+    unsigned int *next_line = malloc(max_lines * sizeof(unsigned int));
+    Span *spans = NULL;
+    size_t num_spans = 0, max_spans = 0;
+    Template *templates = NULL;
+    unsigned int num_templates = 0, max_templates = 0;
+    unsigned int table_size = 1024;
+    unsigned int *table = calloc(table_size, sizeof(unsigned int)); // template + 1, 0 = empty
+    Buffer text = {NULL, 0, 0}; // template text, '\n' separated
+    Buffer line = {NULL, 0, 0}; // scratch for the current template
+    Buffer ids = {NULL, 0, 0}, variables = {NULL, 0, 0}, raw = {NULL, 0, 0};
+    unsigned char *out = NULL;
+    int failed = !line_template || !line_span || !next_line || !table;
+    unsigned int lines = 0;
+    unsigned int pos = 0;
+    while (!failed && pos < size) {
+        unsigned int end = pos;
+        while (end < size && in[end] != '\n') {
+            end++;
+        }
+        line_span[lines] = num_spans;
+        line.size = 0;
+        int keep_raw = memchr(in + pos, SLOT_MARK, end - pos) != NULL;
+        // split into words, words with a digit are variables 
+        for (unsigned int i = pos; !keep_raw && !failed && i < end;) {
+            if (!is_word(in[i])) {
+                failed = buffer_byte(&line, in[i]);
+                i++;
+                continue;
+            }
+            unsigned int start = i;
+            int digit = 0;
+            while (i < end && is_word(in[i])) {
+                digit |= in[i] >= '0' && in[i] <= '9';
+                i++;
+            }
+            if (!digit) {
+                failed = buffer_put(&line, in + start, i - start);
+                continue;
+            }
+            if (num_spans == max_spans) {
+                max_spans = max_spans ? max_spans * 2 : 4096;
+                Span *grown = realloc(spans, max_spans * sizeof(Span));
+                if (!grown) {
+                    failed = 1;
+                    break;
+                }
+                spans = grown;
+            }
+            spans[num_spans].start = start;
+            spans[num_spans].length = i - start;
+            num_spans++;
+            failed = buffer_byte(&line, SLOT_MARK);
+        }
+        if (failed) {
+            break;
+        }
+        unsigned int id = 0;
+        if (keep_raw) {
+            failed = buffer_put(&raw, in + pos, end - pos) || buffer_byte(&raw, '\n');
+        } else {
+            // find or add the template 
+            unsigned int mask = table_size - 1;
+            unsigned int slot = hash_bytes(line.data, line.size) & mask;
+            while (table[slot]) {
+                Template *t = &templates[table[slot] - 1];
+                if (t->length == line.size && 
+                    memcmp(text.data + t->offset, line.data, line.size) == 0) {
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+            if (!table[slot]) {
+                if (num_templates == max_templates) {
+                    max_templates = max_templates ? max_templates * 2 : 256;
+                    Template *grown = realloc(templates, max_templates * sizeof(Template));
+                    if (!grown) {
+                        failed = 1;
+                        break;
+                    }
+                    templates = grown;
+                }
+                Template *t = &templates[num_templates];
+                t->offset = text.size;
+                t->length = line.size;
+                t->slots = num_spans - line_span[lines];
+                t->first_line = t->last_line = lines;
+                failed = buffer_put(&text, line.data, line.size) || buffer_byte(&text, '\n');
+                table[slot] = ++num_templates;
+                // keep the table at most half full 
+                if (!failed && num_templates * 2 > table_size) {
+                    unsigned int *bigger = calloc(table_size * 2, sizeof(unsigned int));
+                    if (!bigger) {
+                        failed = 1;
+                        break;
+                    }
+                    table_size *= 2;
+                    for (unsigned int k = 0; k < num_templates; k++) {
+                        unsigned int s = hash_bytes(text.data + templates[k].offset, 
+                                                    templates[k].length) & (table_size - 1);
+                        while (bigger[s]) {
+                            s = (s + 1) & (table_size - 1);
+                        }
+                        bigger[s] = k + 1;
+                    }
+                    free(table);
+                    table = bigger;
+                }
+                id = num_templates;
+            } else {
+                id = table[slot];
+                Template *t = &templates[id - 1];
+                next_line[t->last_line] = lines;
+                t->last_line = lines;
+            }
+        }
+        line_template[lines] = id;
+        failed = failed || buffer_varint(&ids, id);
+        lines++;
+        pos = end < size ? end + 1 : end;
+    }
+    line_span[lines] = num_spans;
+    // a column holding the same value on every line goes back into the 
+    // template - long runs of one repeated value are the slowest thing to 
+    // hand the BWT sort 
+    unsigned int total_slots = 0;
+    for (unsigned int t = 0; t < num_templates; t++) {
+        total_slots += templates[t].slots;
+    }
+    unsigned char *constant = failed ? NULL : malloc(total_slots ? total_slots : 1);
+    Buffer final_text = {NULL, 0, 0};
+    failed = failed || !constant;
+    for (unsigned int t = 0, first = 0; !failed && t < num_templates; first += templates[t++].slots) {
+        for (unsigned int k = 0; k < templates[t].slots; k++) {
+            Span *value = &spans[line_span[templates[t].first_line] + k];
+            constant[first + k] = 1;
+            for (unsigned int l = templates[t].first_line; l != templates[t].last_line;) {
+                l = next_line[l];
+                Span *span = &spans[line_span[l] + k];
+                if (span->length != value->length || 
+                    memcmp(in + span->start, in + value->start, value->length) != 0) {
+                    constant[first + k] = 0;
+                    break;
+                }
+            }
+        }
+        const unsigned char *p = text.data + templates[t].offset;
+        for (unsigned int i = 0, k = 0; !failed && i < templates[t].length; i++) {
+            if (p[i] != SLOT_MARK || !constant[first + k++]) {
+                failed = buffer_byte(&final_text, p[i]);
+            } else {
+                Span *value = &spans[line_span[templates[t].first_line] + k - 1];
+                failed = buffer_put(&final_text, in + value->start, value->length);
+            }
+        }
+        failed = failed || buffer_byte(&final_text, '\n');
+    }
+    // variables column by column 
+    for (unsigned int t = 0, first = 0; !failed && t < num_templates; first += templates[t++].slots) {
+        for (unsigned int k = 0; !failed && k < templates[t].slots; k++) {
+            if (constant[first + k]) {
+                continue;
+            }
+            for (unsigned int l = templates[t].first_line;; l = next_line[l]) {
+                Span *span = &spans[line_span[l] + k];
+                if (buffer_put(&variables, in + span->start, span->length) != 0 || 
+                    buffer_byte(&variables, '\n') != 0) {
+                    failed = 1;
+                    break;
+                }
+                if (l == templates[t].last_line) {
+                    break;
+                }
+            }
+        }
+    }
+    size_t total = LOG_HEADER_SIZE + final_text.size + ids.size + variables.size + raw.size;
+    // when most lines start a template of their own (json records, prose) 
+    // the templates are just the text again and the split codes worse 
+    if (!failed && total < size && num_templates * 2 <= lines) {
+        out = malloc(total);
+    }
+    if (out) {
+        out[0] = in[size - 1] == '\n' ? 0 : LOG_FLAG_NO_FINAL_NEWLINE;
+        put_u32(out + 1, lines);
+        put_u32(out + 5, num_templates);
+        put_u32(out + 9, final_text.size);
+        put_u32(out + 13, ids.size);
+        put_u32(out + 17, variables.size);
+        put_u32(out + 21, raw.size);
+        unsigned char *p = out + LOG_HEADER_SIZE;
+        memcpy(p, final_text.data, final_text.size);
+        p += final_text.size;
+        memcpy(p, ids.data, ids.size);
+        p += ids.size;
+        memcpy(p, variables.data, variables.size);
+        p += variables.size;
+        memcpy(p, raw.data, raw.size);
+        *out_size = total;
+    }
+    free(line_template);
+    free(line_span);
+    free(next_line);
+    free(spans);
+    free(templates);
+    free(table);
+    free(text.data);
+    free(final_text.data);
+    free(constant);
+    free(line.data);
+    free(ids.data);
+    free(variables.data);
+    free(raw.data);
+    return out;
+}
+
+// next '\n' terminated value, or NULL when the section runs out 
+static const unsigned char *next_value(const unsigned char **p, const unsigned char *end, 
+                                       size_t *length) {
+    const unsigned char *start = *p;
+    const unsigned char *newline = memchr(start, '\n', end - start);
+    if (!newline) {
+        return NULL;
+    }
+    *length = newline - start;
+    *p = newline + 1;
+    return start;
+}
+
+// what the decoder keeps per template 
+typedef struct {
+    unsigned int lines;
+    const unsigned char **text; // per template
+    unsigned int *length;
+    unsigned int *slots;
+    unsigned int *uses; // lines using it
+    unsigned int *first_cursor; // its first column in cursors
+    unsigned int *line_ids;
+    const unsigned char **cursors; // next value of every column
+} LogDecoder;
+
+static int decode_sections(LogDecoder *d, int flags, unsigned int num_templates, 
+                           const unsigned char *text, const unsigned char *ids, 
+                           const unsigned char *variables, const unsigned char *raw, 
+                           const unsigned char *raw_end, unsigned char *out, 
+                           unsigned int out_size) {
+    const unsigned char *p = text;
+    unsigned int total_slots = 0;
+    for (unsigned int t = 0; t < num_templates; t++) {
+        size_t length;
+        d->text[t] = next_value(&p, ids, &length);
+        if (!d->text[t]) {
+            return -1;
+        }
+        d->length[t] = length;
+        d->slots[t] = 0;
+        for (size_t i = 0; i < length; i++) {
+            d->slots[t] += d->text[t][i] == SLOT_MARK;
+        }
+        d->first_cursor[t] = total_slots;
+        total_slots += d->slots[t];
+    }
+    p = ids;
+    for (unsigned int l = 0; l < d->lines; l++) {
+        unsigned int id = 0;
+        for (int shift = 0;; shift += 7) {
+            if (p == variables || shift > 28) {
+                return -1;
+            }
+            id |= (unsigned int)(*p & 0x7F) << shift;
+            if (!(*p++ & 0x80)) {
+                break;
+            }
+        }
+        if (id > num_templates) {
+            return -1;
+        }
+        d->line_ids[l] = id;
+        if (id) {
+            d->uses[id - 1]++;
+        }
+    }
+    // find where every column starts 
+    d->cursors = malloc((total_slots ? total_slots : 1) * sizeof(unsigned char *));
+    if (!d->cursors) {
+        return -1;
+    }
+    p = variables;
+    for (unsigned int t = 0; t < num_templates; t++) {
+        for (unsigned int k = 0; k < d->slots[t]; k++) {
+            d->cursors[d->first_cursor[t] + k] = p;
+            for (unsigned int n = 0; n < d->uses[t]; n++) {
+                size_t length;
+                if (!next_value(&p, raw, &length)) {
+                    return -1;
+                }
+            }
+        }
+    }
+    // and rebuild the lines in order 
+    unsigned char *o = out;
+    unsigned char *o_end = out + out_size;
+    for (unsigned int l = 0; l < d->lines; l++) {
+        if (d->line_ids[l] == 0) {
+            size_t length;
+            const unsigned char *value = next_value(&raw, raw_end, &length);
+            if (!value || length > (size_t)(o_end - o)) {
+                return -1;
+            }
+            memcpy(o, value, length);
+            o += length;
+        } else {
+            unsigned int t = d->line_ids[l] - 1;
+            const unsigned char **cursor = &d->cursors[d->first_cursor[t]];
+            for (unsigned int i = 0; i < d->length[t]; i++) {
+                if (d->text[t][i] != SLOT_MARK) {
+                    if (o == o_end) {
+                        return -1;
+                    }
+                    *o++ = d->text[t][i];
+                    continue;
+                }
+                size_t length;
+                const unsigned char *value = next_value(cursor++, raw, &length);
+                if (!value || length > (size_t)(o_end - o)) {
+                    return -1;
+                }
+                memcpy(o, value, length);
+                o += length;
+            }
+        }
+        if (l + 1 < d->lines || !(flags & LOG_FLAG_NO_FINAL_NEWLINE)) {
+            if (o == o_end) {
+                return -1;
+            }
+            *o++ = '\n';
+        }
+    }
+    return o == o_end ? 0 : -1;
+}
+
+int log_template_decode(const unsigned char *in, unsigned int size, unsigned char *out, 
+                        unsigned int out_size) {
+    if (size < LOG_HEADER_SIZE) {
+        return -1;
+    }
+    int flags = in[0];
+    unsigned int num_templates = get_u32(in + 5);
+    unsigned long long sections[4];
+    unsigned long long total = LOG_HEADER_SIZE;
+    for (int s = 0; s < 4; s++) {
+        sections[s] = get_u32(in + 9 + 4 * s);
+        total += sections[s];
+    }
+    LogDecoder d;
+    memset(&d, 0, sizeof(d));
+    d.lines = get_u32(in + 1);
+    // every template and every line id takes at least a byte 
+    if (total != size || num_templates > sections[0] || d.lines > sections[1]) {
+        return -1;
+    }
+    const unsigned char *text = in + LOG_HEADER_SIZE;
+    const unsigned char *ids = text + sections[0];
+    const unsigned char *variables = ids + sections[1];
+    const unsigned char *raw = variables + sections[2];
+    size_t count = num_templates + 1;
+    d.text = malloc(count * sizeof(unsigned char *));
+    d.length = malloc(count * sizeof(unsigned int));
+    d.slots = malloc(count * sizeof(unsigned int));
+    d.uses = calloc(count, sizeof(unsigned int));
+    d.first_cursor = malloc(count * sizeof(unsigned int));
+    d.line_ids = malloc((d.lines + 1) * sizeof(unsigned int));
+    int result = -1;
+    if (d.text && d.length && d.slots && d.uses && d.first_cursor && d.line_ids) {
+        result = decode_sections(&d, flags, num_templates, text, ids, variables, raw, 
+                                 raw + sections[3], out, out_size);
+    }
+    free(d.text);
+    free(d.length);
+    free(d.slots);
+    free(d.uses);
+    free(d.first_cursor);
+    free(d.line_ids);
+    free(d.cursors);
+    return result;
+}
+
+int log_template_helps(CodecId codec) {
+    return codec == CODEC_GZIP;
+}
+
+int log_template_compress(const unsigned char *stream, unsigned int size, 
+                          CompressedBlock *output, const EncoderConfig *config) {
+    if (size < LOG_HEADER_SIZE) {
+        return -1;
+    }
+    CompressedBlock parts[LOG_SECTIONS];
+    memset(parts, 0, sizeof(parts));
+    const unsigned char *p = stream + LOG_HEADER_SIZE;
+    size_t total = LOG_HEADER_SIZE;
+    int result = 0;
+    for (int s = 0; s < LOG_SECTIONS && result == 0; s++) {
+        unsigned int length = get_u32(stream + 9 + 4 * s);
+        // an empty section (no raw lines, say) is just its size 
+        if (length && compress_block((unsigned char *)p, length, &parts[s], config) != 0) {
+            result = -1;
+        }
+        p += length;
+        total += 4 + parts[s].size;
+    }
+    if (result == 0 && block_alloc(output, total) != 0) {
+        fprintf(stderr, "Memory allocation failed in compress_block\n");
+        result = -1;
+    }
+    if (result == 0) {
+        memcpy(output->data, stream, LOG_HEADER_SIZE);
+        unsigned char *o = output->data + LOG_HEADER_SIZE;
+        for (int s = 0; s < LOG_SECTIONS; s++) {
+            put_u32(o, parts[s].size);
+            memcpy(o + 4, parts[s].data, parts[s].size);
+            o += 4 + parts[s].size;
+        }
+        output->size = total;
+        output->original_size = output->raw_size = size;
+        output->codec = config->codec;
+    }
+    for (int s = 0; s < LOG_SECTIONS; s++) {
+        block_release(&parts[s]);
+    }
+    return result;
+}
+
+int log_template_decompress(const unsigned char *in, unsigned int size, 
+                            unsigned char *stream, unsigned int stream_size, 
+                            const EncoderConfig *config) {
+    if (size < LOG_HEADER_SIZE || stream_size < LOG_HEADER_SIZE) {
+        return -1;
+    }
+    memcpy(stream, in, LOG_HEADER_SIZE);
+    const unsigned char *p = in + LOG_HEADER_SIZE;
+    const unsigned char *end = in + size;
+    unsigned long long at = LOG_HEADER_SIZE;
+    for (int s = 0; s < LOG_SECTIONS; s++) {
+        unsigned int length = get_u32(in + 9 + 4 * s);
+        if (end - p < 4) {
+            return -1;
+        }
+        unsigned int compressed = get_u32(p);
+        p += 4;
+        if (compressed > (size_t)(end - p) || at + length > stream_size || 
+            (length == 0) != (compressed == 0)) {
+            return -1;
+        }
+        if (length && decompress_block(p, compressed, stream + at, length, config) != 0) {
+            return -1;
+        }
+        p += compressed;
+        at += length;
+    }
+    return p == end && at == stream_size ? 0 : -1;
+}
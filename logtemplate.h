@@ -0,0 +1,47 @@
+#ifndef LOGTEMPLATE_H
+#define LOGTEMPLATE_H
+
+#include "block.h"
+#include "codec.h"
+
+// log template transform: every line of a block becomes a template (the 
+// line with each token containing a digit replaced by \1) plus those 
+// tokens. the block is rewritten as 
+//   u8 flags u32 lines u32 templates u32 template_bytes u32 id_bytes 
+//   u32 variable_bytes u32 raw_bytes 
+//   templates     each ending in '\n' 
+//   ids           varint per line, 0 for a raw line, else template + 1 
+//   variables     column by column: for each template, for each slot, the 
+//                 values of every line using it, each ending in '\n' 
+//   raw           lines kept as they are (they contained \1), each ending in '\n' 
+// so similar values end up next to each other for the codec 
+#define LOG_HEADER_SIZE 25
+#define LOG_SECTIONS 4
+// the block did not end in a newline 
+#define LOG_FLAG_NO_FINAL_NEWLINE 1
+
+// returns a malloc'd stream, or NULL when the block would not shrink 
+unsigned char *log_template_encode(const unsigned char *in, unsigned int size, 
+                                   unsigned int *out_size);
+int log_template_decode(const unsigned char *in, unsigned int size, unsigned char *out, 
+                        unsigned int out_size);
+
+// the split only pays off for gz - its 32k window never sees the repeats 
+// the columns line up. bwt coders (bz2, bwt-fast, bwt-huff) already find 
+// them in the raw lines and came out slightly bigger on the split streams, 
+// so their blocks are left unfiltered 
+int log_template_helps(CodecId codec);
+
+// filter param of a log block whose sections were coded one by one - the 
+// header as it is, then per section u32 compressed size and the data, so 
+// the codec never sees template text, ids and values mixed together. 
+// param 0 blocks hold the whole stream coded in one go 
+#define LOG_PARAM_SECTIONS 1
+int log_template_compress(const unsigned char *stream, unsigned int size, 
+                          CompressedBlock *output, const EncoderConfig *config);
+// back to the stream log_template_decode takes - stream_size is raw_size 
+int log_template_decompress(const unsigned char *in, unsigned int size, 
+                            unsigned char *stream, unsigned int stream_size, 
+                            const EncoderConfig *config);
+
+#endif
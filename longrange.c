@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "longrange.h"
+
+// anchors are content defined: one every ~256 bytes, keyed by a hash of 
+// the 64 bytes before them, so shifted copies still line up 
+#define ANCHOR_SHIFT 56
+// bytes the rolling hash needs before it covers a full window 
+#define HASH_WARMUP 64
+// shorter matches cost more in tokens than the codec would spend on them 
+#define MIN_MATCH 64
+
+typedef struct {
+    uint64_t hash;
+    unsigned int position; // within the block, just past the hashed bytes
+} Anchor;
+
+typedef struct {
+    Anchor *anchors;
+    int count;
+    int capacity;
+} AnchorList;
+
+typedef struct {
+    uint64_t hash;
+    long long position; // absolute, -1 when the slot is empty
+} TableEntry;
+
+static uint64_t gear[256];
+
+// gear hash table from a fixed seed - the decoder never needs it, but the 
+// same input should always give the same archive 
+static void gear_init(void) {
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    for (int i = 0; i < 256; i++) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        gear[i] = z ^ (z >> 31);
+    }
+}
+
+static int anchor_push(AnchorList *list, uint64_t hash, unsigned int position) {
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 1024;
+        Anchor *grown = realloc(list->anchors, capacity * sizeof(Anchor));
+        if (!grown) {
+            return -1;
+        }
+        list->anchors = grown;
+        list->capacity = capacity;
+    }
+    list->anchors[list->count].hash = hash;
+    list->anchors[list->count].position = position;
+    list->count++;
+    return 0;
+}
+
+// the high bits of a gear hash depend on the last 64 bytes only, so the 
+// hash is started that far before the block to match the rest of the file 
+static int find_anchors(const unsigned char *data, long long start, long long end, 
+                        AnchorList *list) {
+    long long warm = start > HASH_WARMUP ? start - HASH_WARMUP : 0;
+    uint64_t hash = 0;
+    for (long long i = warm; i < start; i++) {
+        hash = (hash << 1) + gear[data[i]];
+    }
+    for (long long i = start; i < end; i++) {
+        hash = (hash << 1) + gear[data[i]];
+        if ((hash >> ANCHOR_SHIFT) == 0 && i + 1 - warm >= HASH_WARMUP) {
+            if (anchor_push(list, hash, (unsigned int)(i + 1 - start)) != 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static long long table_find(const TableEntry *table, uint64_t mask, uint64_t hash) {
+    for (uint64_t slot = hash & mask; table[slot].position >= 0; slot = (slot + 1) & mask) {
+        if (table[slot].hash == hash) {
+            return table[slot].position;
+        }
+    }
+    return -1;
+}
+
+static unsigned char *put_varint(unsigned char *p, unsigned long long value) {
+    while (value >= 0x80) {
+        *p++ = (unsigned char)value | 0x80;
+        value >>= 7;
+    }
+    *p++ = (unsigned char)value;
+    return p;
+}
+
+// replace the parts of one block that repeat earlier blocks - returns the 
+// token stream, or NULL when nothing was worth replacing 
+static unsigned char *match_block(const unsigned char *data, long long start, long long end, 
+                                  const AnchorList *list, const TableEntry *table, 
+                                  uint64_t mask, long long window, unsigned int *token_size, 
+                                  long long *matched, long long *matches) {
+    // a match replaces at least MIN_MATCH bytes with at most 21 token 
+    // bytes, so literals plus a little slack always fit 
+    unsigned char *tokens = NULL;
+    unsigned char *out = NULL;
+    long long cursor = start;
+    for (int a = 0; a < list->count; a++) {
+        long long dst = start + list->anchors[a].position;
+        if (dst < cursor) {
+            continue;
+        }
+        long long src = table_find(table, mask, list->anchors[a].hash);
+        // only earlier blocks are decoded by the time this one expands 
+        if (src < 0 || src > start || dst - src > window) {
+            continue;
+        }
+        long long src_end = src;
+        long long dst_end = dst;
+        while (dst > cursor && src > 0 && data[dst - 1] == data[src - 1]) {
+            dst--;
+            src--;
+        }
+        while (dst_end < end && src_end < start && data[dst_end] == data[src_end]) {
+            dst_end++;
+            src_end++;
+        }
+        if (dst_end - dst < MIN_MATCH) {
+            continue;
+        }
+        if (!tokens) {
+            tokens = malloc(end - start + 32);
+            if (!tokens) {
+                return NULL;
+            }
+            out = tokens;
+        }
+        out = put_varint(out, dst - cursor);
+        memcpy(out, data + cursor, dst - cursor);
+        out += dst - cursor;
+        out = put_varint(out, dst_end - dst);
+        out = put_varint(out, dst - src);
+        *matched += dst_end - dst;
+        (*matches)++;
+        cursor = dst_end;
+    }
+    if (!tokens) {
+        return NULL;
+    }
+    out = put_varint(out, end - cursor);
+    memcpy(out, data + cursor, end - cursor);
+    out += end - cursor;
+    out = put_varint(out, 0);
+    *token_size = out - tokens;
+    return tokens;
+}
+
+// anchors for every block in parallel, one table of where each anchor 
+// first occurs, then every block is matched against it in parallel 
+int long_range_plan(const unsigned char *data, long long size, unsigned int block_size, 
+                    int num_blocks, long long window, LongRangePlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    gear_init();
+    AnchorList *lists = calloc(num_blocks ? num_blocks : 1, sizeof(AnchorList));
+    plan->tokens = calloc(num_blocks ? num_blocks : 1, sizeof(unsigned char *));
+    plan->token_size = calloc(num_blocks ? num_blocks : 1, sizeof(unsigned int));
+    if (!lists || !plan->tokens || !plan->token_size) {
+        fprintf(stderr, "Memory allocation failed\n");
+        free(lists);
+        long_range_free(plan, 0);
+        return -1;
+    }
+    int errors = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < num_blocks; i++) {
+        long long start = (long long)i * block_size;
+        long long end = start + block_size < size ? start + block_size : size;
+        if (find_anchors(data, start, end, &lists[i]) != 0) {
+            #pragma omp atomic
+            errors++;
+        }
+    }
+    long long total = 0;
+    for (int i = 0; i < num_blocks; i++) {
+        total += lists[i].count;
+    }
+    uint64_t slots = 1024;
+    while (slots < (uint64_t)total * 2) {
+        slots <<= 1;
+    }
+    TableEntry *table = errors ? NULL : malloc(slots * sizeof(TableEntry));
+    if (table) {
+        uint64_t mask = slots - 1;
+        for (uint64_t s = 0; s < slots; s++) {
+            table[s].position = -1;
+        }
+        // in block order, so the first occurrence wins 
+        for (int i = 0; i < num_blocks; i++) {
+            long long start = (long long)i * block_size;
+            for (int a = 0; a < lists[i].count; a++) {
+                uint64_t hash = lists[i].anchors[a].hash;
+                uint64_t slot = hash & mask;
+                while (table[slot].position >= 0 && table[slot].hash != hash) {
+                    slot = (slot + 1) & mask;
+                }
+                if (table[slot].position < 0) {
+                    table[slot].hash = hash;
+                    table[slot].position = start + lists[i].anchors[a].position;
+                }
+            }
+        }
+        long long matched = 0;
+        long long matches = 0;
+        #pragma omp parallel for schedule(dynamic) reduction(+:matched, matches)
+        for (int i = 0; i < num_blocks; i++) {
+            long long start = (long long)i * block_size;
+            long long end = start + block_size < size ? start + block_size : size;
+            plan->tokens[i] = match_block(data, start, end, &lists[i], table, mask, window, 
+                                          &plan->token_size[i], &matched, &matches);
+        }
+        plan->matched = matched;
+        plan->matches = matches;
+        free(table);
+    } else {
+        fprintf(stderr, "Memory allocation failed for long range matching\n");
+        errors++;
+    }
+    for (int i = 0; i < num_blocks; i++) {
+        free(lists[i].anchors);
+    }
+    free(lists);
+    if (errors) {
+        long_range_free(plan, num_blocks);
+        return -1;
+    }
+    return 0;
+}
+
+void long_range_free(LongRangePlan *plan, int num_blocks) {
+    if (plan->tokens) {
+        for (int i = 0; i < num_blocks; i++) {
+            free(plan->tokens[i]);
+        }
+    }
+    free(plan->tokens);
+    free(plan->token_size);
+    plan->tokens = NULL;
+    plan->token_size = NULL;
+}
+
+void history_init(LongRangeHistory *history, long long window) {
+    history->ring = NULL;
+    history->capacity = 0;
+    history->window = window;
+    history->position = 0;
+}
+
+// byte p of the stream lives at p % window - until the window fills up 
+// the ring is simply a growing buffer 
+int history_append(LongRangeHistory *history, const unsigned char *data, unsigned int size) {
+    long long needed = history->position + size;
+    if (needed > history->capacity && history->capacity < history->window) {
+        long long capacity = history->capacity ? history->capacity : 1 << 20;
+        while (capacity < needed && capacity < history->window) {
+            capacity *= 2;
+        }
+        if (capacity > history->window) {
+            capacity = history->window;
+        }
+        unsigned char *grown = realloc(history->ring, capacity);
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed for long range history\n");
+            return -1;
+        }
+        history->ring = grown;
+        history->capacity = capacity;
+    }
+    // a block bigger than the window only needs its tail 
+    if (size > history->window) {
+        history->position += size - history->window;
+        data += size - history->window;
+        size = history->window;
+    }
+    while (size > 0) {
+        long long at = history->position % history->window;
+        unsigned int n = history->window - at < size ? history->window - at : size;
+        memcpy(history->ring + at, data, n);
+        history->position += n;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+void history_free(LongRangeHistory *history) {
+    free(history->ring);
+    history->ring = NULL;
+}
+
+static int get_varint(const unsigned char **p, const unsigned char *end, 
+                      unsigned long long *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p == end) {
+            return -1;
+        }
+        unsigned char byte = *(*p)++;
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int long_range_expand(const unsigned char *tokens, unsigned int size, unsigned char *out, 
+                      unsigned int out_size, const LongRangeHistory *history) {
+    const unsigned char *p = tokens;
+    const unsigned char *end = tokens + size;
+    unsigned int at = 0;
+    for (;;) {
+        unsigned long long literal, length, distance;
+        if (get_varint(&p, end, &literal) != 0 || literal > out_size - at || 
+            literal > (unsigned long long)(end - p)) {
+            return -1;
+        }
+        memcpy(out + at, p, literal);
+        p += literal;
+        at += literal;
+        if (get_varint(&p, end, &length) != 0 || length > out_size - at) {
+            return -1;
+        }
+        if (length == 0) {
+            break;
+        }
+        if (get_varint(&p, end, &distance) != 0) {
+            return -1;
+        }
+        // the source has to be wholly in earlier blocks and still in the window 
+        long long src = history->position + at - (long long)distance;
+        if (distance > (unsigned long long)history->window || src < 0 || 
+            src + (long long)length > history->position || 
+            src < history->position - history->window) {
+            return -1;
+        }
+        while (length > 0) {
+            long long from = src % history->window;
+            unsigned int n = history->window - from < (long long)length ? 
+                             (unsigned int)(history->window - from) : length;
+            memcpy(out + at, history->ring + from, n);
+            src += n;
+            at += n;
+            length -= n;
+        }
+    }
+    return at == out_size && p == end ? 0 : -1;
+}
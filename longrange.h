@@ -0,0 +1,43 @@
+#ifndef LONGRANGE_H
+#define LONGRANGE_H
+
+// long range matching: repeats further apart than one block (which the 
+// codecs never see) are replaced by references to earlier blocks before 
+// the blocks are compressed. a matched block becomes a token stream of 
+//   varint literal_length, literal bytes, varint match_length 
+//   [varint distance when match_length > 0] 
+// repeated until the block is complete. distance counts back from the 
+// match to its source, which always lies wholly in an earlier block - so 
+// blocks still decode in parallel and only the expansion runs in order 
+
+// default and largest distance a reference may reach back 
+#define LONG_RANGE_WINDOW (1LL << 30)
+#define LONG_RANGE_MAX_WINDOW (1LL << 40)
+
+typedef struct {
+    unsigned char **tokens; // per block, NULL when nothing in it matched
+    unsigned int *token_size;
+    long long matched; // bytes replaced by references
+    long long matches;
+} LongRangePlan;
+
+int long_range_plan(const unsigned char *data, long long size, unsigned int block_size, 
+                    int num_blocks, long long window, LongRangePlan *plan);
+void long_range_free(LongRangePlan *plan, int num_blocks);
+
+// everything decoded so far within the window, for the expansion 
+typedef struct {
+    unsigned char *ring;
+    long long capacity; // grows up to window
+    long long window;
+    long long position; // bytes seen so far
+} LongRangeHistory;
+
+void history_init(LongRangeHistory *history, long long window);
+int history_append(LongRangeHistory *history, const unsigned char *data, unsigned int size);
+void history_free(LongRangeHistory *history);
+// tokens -> out_size bytes, resolving references against the history 
+int long_range_expand(const unsigned char *tokens, unsigned int size, unsigned char *out, 
+                      unsigned int out_size, const LongRangeHistory *history);
+
+#endif
@@ -0,0 +1,292 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "block.h"
+#include "output.h"
+
+// when set blocks live in their own page mappings instead of the malloc heap
+static int page_buffers = 0;
+
+void block_set_page_buffers(int enabled) {
+    page_buffers = enabled;
+}
+
+static size_t page_round(size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+int block_alloc(CompressedBlock *block, unsigned int size) {
+    block->capacity = 0;
+    if (!page_buffers) {
+        block->data = malloc(size);
+        return block->data ? 0 : -1;
+    }
+    // a private mapping per block - the pipe can keep referencing these
+    // pages after we unmap them, which is never true of heap memory
+    size_t length = page_round(size);
+    void *map = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        block->data = NULL;
+        return -1;
+    }
+    block->data = map;
+    block->capacity = length;
+    return 0;
+}
+
+void block_shrink(CompressedBlock *block) {
+    if (!block->data) {
+        return;
+    }
+    if (!block->capacity) {
+        // shrink the buffer to actual size
+        unsigned char *shrunk = realloc(block->data, block->size);
+        if (shrunk) {
+            block->data = shrunk;
+        }
+        return;
+    }
+    // give back the whole pages past the compressed data
+    size_t keep = page_round(block->size);
+    if (keep == 0) {
+        keep = page_round(1);
+    }
+    if (keep < block->capacity) {
+        munmap(block->data + keep, block->capacity - keep);
+        block->capacity = keep;
+    }
+}
+
+void block_release(CompressedBlock *block) {
+    if (!block->data) {
+        return;
+    }
+    if (block->capacity) {
+        munmap(block->data, block->capacity);
+    } else {
+        free(block->data);
+    }
+    block->data = NULL;
+    block->capacity = 0;
+}
+
+int output_is_pipe(const char *path) {
+    struct stat st;
+    int result = strcmp(path, "-") == 0 ? fstat(STDOUT_FILENO, &st) : stat(path, &st);
+    return result == 0 && S_ISFIFO(st.st_mode);
+}
+
+int sink_open(OutputSink *sink, const char *path, int durable) {
+    sink->path = path;
+    sink->gift = 0;
+    sink->durable = 0;
+    sink->temp_path = NULL;
+    sink->written = sink->flushed = sink->synced = 0;
+    if (strcmp(path, "-") == 0) {
+        sink->fd = STDOUT_FILENO;
+    } else if (durable && !output_is_pipe(path)) {
+        // write next to the target and rename once everything is on disk,
+        // so a crash never leaves a truncated archive under the real name
+        sink->temp_path = malloc(strlen(path) + sizeof(".partial"));
+        if (!sink->temp_path) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        sprintf(sink->temp_path, "%s.partial", path);
+        sink->fd = open(sink->temp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (sink->fd < 0) {
+            perror("Error opening output file");
+            free(sink->temp_path);
+            sink->temp_path = NULL;
+            return -1;
+        }
+        sink->durable = 1;
+    } else {
+        sink->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (sink->fd < 0) {
+            perror("Error opening output file");
+            return -1;
+        }
+    }
+    struct stat st;
+    sink->is_pipe = fstat(sink->fd, &st) == 0 && S_ISFIFO(st.st_mode);
+    return 0;
+}
+
+// plain write loop - used for files and whenever vmsplice is unavailable
+static int write_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+// map the compressed bytes straight into the pipe instead of copying them
+static int splice_all(OutputSink *sink, const unsigned char *data, size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    while (size > 0) {
+        struct iovec iov = { (void *)data, size };
+        unsigned int flags = 0;
+        // only whole, page aligned pages can be gifted - the tail is
+        // spliced as a plain reference
+        if (sink->gift && ((uintptr_t)data & (page - 1)) == 0 && size >= page) {
+            iov.iov_len = size & ~(page - 1);
+            flags = SPLICE_F_GIFT;
+        }
+        ssize_t n = vmsplice(sink->fd, &iov, 1, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL || errno == ENOSYS) {
+                // kernel refuses this buffer - stop trying and copy instead
+                sink->is_pipe = 0;
+                return write_all(sink->fd, data, size);
+            }
+            return -1;
+        }
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+#endif
+
+// keep writeback rolling a window behind the writer instead of leaving
+// gigabytes of dirty pages for one huge fsync at the end
+static void sync_behind(OutputSink *sink) {
+#ifdef __linux__
+    while (sink->written - sink->flushed >= SYNC_WINDOW) {
+        // start writeback of the newest full window, don't wait for it
+        sync_file_range(sink->fd, sink->flushed, SYNC_WINDOW,
+                        SYNC_FILE_RANGE_WRITE);
+        // wait for the window before it, which has had a whole window of
+        // time to hit the disk already
+        if (sink->flushed - sink->synced >= SYNC_WINDOW) {
+            sync_file_range(sink->fd, sink->synced, SYNC_WINDOW,
+                            SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+                            SYNC_FILE_RANGE_WAIT_AFTER);
+            // clean now - no reason to keep it in the page cache
+            posix_fadvise(sink->fd, sink->synced, SYNC_WINDOW, POSIX_FADV_DONTNEED);
+            sink->synced += SYNC_WINDOW;
+        }
+        sink->flushed += SYNC_WINDOW;
+    }
+#endif
+}
+
+static int sink_put(OutputSink *sink, const unsigned char *data, size_t size, int splice) {
+    int result;
+#ifndef __linux__
+    (void)splice;
+#else
+    if (splice && sink->is_pipe) {
+        result = splice_all(sink, data, size);
+    } else
+#endif
+    result = write_all(sink->fd, data, size);
+    if (result != 0) {
+        return result;
+    }
+    sink->written += (long long)size;
+    if (sink->durable) {
+        sync_behind(sink);
+    }
+    return 0;
+}
+
+int sink_write(OutputSink *sink, const unsigned char *data, size_t size) {
+    // the pipe would only hold a reference to these bytes, and the caller
+    // is free to overwrite them (headers live on the stack) before the
+    // reader gets to them - so they are always copied
+    return sink_put(sink, data, size, 0);
+}
+
+int sink_write_block(OutputSink *sink, const CompressedBlock *block) {
+    // heap blocks can be reused after free, so only splice mapped ones
+    return sink_put(sink, block->data, block->size, block->capacity != 0);
+}
+
+// make the rename itself durable
+int sync_parent_dir(const char *path) {
+    char *copy = strdup(path);
+    if (!copy) {
+        return -1;
+    }
+    int dir = open(dirname(copy), O_RDONLY | O_DIRECTORY);
+    free(copy);
+    if (dir < 0) {
+        return -1;
+    }
+    int result = fsync(dir);
+    close(dir);
+    return result;
+}
+
+int sink_close(OutputSink *sink) {
+    if (sink->fd == STDOUT_FILENO) {
+        return 0;
+    }
+    int result = 0;
+    if (sink->durable) {
+        // only the tail since the last window is still dirty here
+        if (fdatasync(sink->fd) != 0) {
+            perror("fdatasync");
+            result = -1;
+        }
+    }
+    if (close(sink->fd) != 0) {
+        result = -1;
+    }
+    sink->fd = -1;
+    if (sink->temp_path) {
+        if (result == 0 && rename(sink->temp_path, sink->path) != 0) {
+            perror("Error renaming output file");
+            result = -1;
+        }
+        if (result == 0 && sync_parent_dir(sink->path) != 0) {
+            perror("fsync of output directory");
+            result = -1;
+        }
+        if (result != 0) {
+            unlink(sink->temp_path);
+        }
+        free(sink->temp_path);
+        sink->temp_path = NULL;
+    }
+    return result;
+}
+
+// give up on a sink after a write error - a durable temp file is removed
+// instead of being renamed over the target
+void sink_abort(OutputSink *sink) {
+    if (sink->fd != STDOUT_FILENO && sink->fd >= 0) {
+        close(sink->fd);
+    }
+    sink->fd = -1;
+    if (sink->temp_path) {
+        unlink(sink->temp_path);
+        free(sink->temp_path);
+        sink->temp_path = NULL;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>
+#include "block.h"
+
+typedef struct {
+    const char *path; // "-" means stdout
+    int fd;
+    int is_pipe; // fd is a pipe so blocks can be spliced in
+    int gift; // pages may be gifted to the pipe (nobody else reads them)
+    int durable; // flush behind the writer and fdatasync + rename on close
+    char *temp_path; // durable files are written here and renamed on close
+    long long written; // bytes written so far
+    long long flushed; // writeback has been started up to here
+    long long synced; // writeback has completed up to here
+} OutputSink;
+
+// durable mode starts writeback every window and waits one window behind
+#define SYNC_WINDOW (8LL * 1024 * 1024)
+
+// is this output path (or stdout for "-") a pipe
+int output_is_pipe(const char *path);
+int sink_open(OutputSink *sink, const char *path, int durable);
+// copies data - safe for stack and heap buffers the caller reuses
+int sink_write(OutputSink *sink, const unsigned char *data, size_t size);
+// a block's compressed bytes - spliced into a pipe when the block is page
+// mapped, as its pages are never written again, copied otherwise
+int sink_write_block(OutputSink *sink, const CompressedBlock *block);
+int sink_close(OutputSink *sink);
+void sink_abort(OutputSink *sink);
+// fsync the directory holding path, so a rename into it is durable
+int sync_parent_dir(const char *path);
+
+#endif
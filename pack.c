@@ -0,0 +1,332 @@
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ftw.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "codec.h"
+#include "container.h"
+#include "output.h"
+#include "pack.h"
+
+// nftw has no user pointer, so the walk collects into these 
+static PackPlan *scan_plan;
+static size_t scan_root_len;
+static int scan_max_members;
+
+static int collect_file(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+    (void)ftw;
+    if (type != FTW_F || !S_ISREG(st->st_mode)) {
+        return 0;
+    }
+    const char *name = path + scan_root_len;
+    while (*name == '/') {
+        name++;
+    }
+    // the index is line based and sizes are 32 bit 
+    if (strchr(name, '\n') || st->st_size > 0xFFFF0000LL) {
+        fprintf(stderr, "Skipping %s\n", path);
+        return 0;
+    }
+    if (scan_plan->num_members == scan_max_members) {
+        scan_max_members = scan_max_members ? scan_max_members * 2 : 1024;
+        PackMember *grown = realloc(scan_plan->members, scan_max_members * sizeof(PackMember));
+        if (!grown) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        scan_plan->members = grown;
+    }
+    PackMember *member = &scan_plan->members[scan_plan->num_members++];
+    member->path = strdup(path);
+    member->name = strdup(name);
+    member->size = (unsigned int)st->st_size;
+    if (!member->path || !member->name) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int compare_members(const void *a, const void *b) {
+    return strcmp(((const PackMember *)a)->name, ((const PackMember *)b)->name);
+}
+
+static unsigned int table_entry_size(const PackMember *member) {
+    return 8 + strlen(member->name);
+}
+
+int pack_scan(const char *dir, unsigned int block_size, PackPlan *plan) {
+    memset(plan, 0, sizeof(*plan));
+    scan_plan = plan;
+    scan_root_len = strlen(dir);
+    scan_max_members = 0;
+    if (nftw(dir, collect_file, 64, FTW_PHYS) != 0) {
+        perror(dir);
+        pack_free(plan);
+        return -1;
+    }
+    // sorted names keep related files in the same block and the archive 
+    // reproducible 
+    qsort(plan->members, plan->num_members, sizeof(PackMember), compare_members);
+    plan->blocks = calloc(plan->num_members ? plan->num_members : 1, sizeof(PackBlock));
+    if (!plan->blocks) {
+        fprintf(stderr, "Memory allocation failed\n");
+        pack_free(plan);
+        return -1;
+    }
+    // fill blocks up to block_size - a file bigger than that gets a block 
+    // to itself 
+    PackBlock *block = NULL;
+    unsigned long long data_size = 0;
+    unsigned long long table_size = 0;
+    for (int i = 0; i < plan->num_members; i++) {
+        PackMember *member = &plan->members[i];
+        unsigned long long entry = table_entry_size(member);
+        if (!block || (block->num_members > 0 && 
+                       4 + table_size + entry + data_size + member->size > block_size)) {
+            block = &plan->blocks[plan->num_blocks++];
+            block->first_member = i;
+            block->num_members = 0;
+            data_size = table_size = 0;
+        }
+        block->num_members++;
+        table_size += entry;
+        data_size += member->size;
+        member->block = plan->num_blocks - 1;
+        plan->total_size += member->size;
+    }
+    // now the table sizes are final, place the members 
+    for (int b = 0; b < plan->num_blocks; b++) {
+        PackBlock *pb = &plan->blocks[b];
+        unsigned long long offset = 4;
+        for (int m = 0; m < pb->num_members; m++) {
+            offset += table_entry_size(&plan->members[pb->first_member + m]);
+        }
+        for (int m = 0; m < pb->num_members; m++) {
+            PackMember *member = &plan->members[pb->first_member + m];
+            member->offset = offset;
+            offset += member->size;
+        }
+        if (offset > 0xFFFFFFFFULL) {
+            fprintf(stderr, "Packed block %d is too large\n", b);
+            pack_free(plan);
+            return -1;
+        }
+        pb->size = offset;
+    }
+    return 0;
+}
+
+// read() may return less than asked for (and caps one call near 2 GB), so 
+// keep going until the member is complete - ending early means it shrank 
+static int read_member(int fd, unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = read(fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+unsigned char *pack_build_block(const PackPlan *plan, int block) {
+    const PackBlock *pb = &plan->blocks[block];
+    unsigned char *data = malloc(pb->size ? pb->size : 1);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    // member table 
+    unsigned char *p = data;
+    put_u32(p, pb->num_members);
+    p += 4;
+    for (int m = 0; m < pb->num_members; m++) {
+        const PackMember *member = &plan->members[pb->first_member + m];
+        unsigned int name_len = strlen(member->name);
+        put_u32(p, name_len);
+        put_u32(p + 4, member->size);
+        memcpy(p + 8, member->name, name_len);
+        p += 8 + name_len;
+    }
+    // then the files themselves 
+    for (int m = 0; m < pb->num_members; m++) {
+        const PackMember *member = &plan->members[pb->first_member + m];
+        int fd = open(member->path, O_RDONLY);
+        if (fd < 0 || read_member(fd, data + member->offset, member->size) != 0) {
+            fprintf(stderr, "Error reading %s\n", member->path);
+            if (fd >= 0) {
+                close(fd);
+            }
+            free(data);
+            return NULL;
+        }
+        close(fd);
+    }
+    return data;
+}
+
+int pack_write_index(const PackPlan *plan, const CompressedBlock *blocks, 
+                     const char *index_path, int durable) {
+    FILE *index = fopen(index_path, "w");
+    if (!index) {
+        perror(index_path);
+        return -1;
+    }
+    fprintf(index, "# parallel_bzip2 pack index v1\n");
+    // B block archive_offset compressed_size original_size 
+    long long offset = 0;
+    for (int b = 0; b < plan->num_blocks; b++) {
+        fprintf(index, "B\t%d\t%lld\t%u\t%u\n", b, offset, blocks[b].size, 
+                blocks[b].original_size);
+        offset += blocks[b].size;
+    }
+    // M block offset_in_block size name 
+    for (int i = 0; i < plan->num_members; i++) {
+        const PackMember *member = &plan->members[i];
+        fprintf(index, "M\t%d\t%u\t%u\t%s\n", member->block, member->offset, member->size, 
+                member->name);
+    }
+    int result = 0;
+    if (fflush(index) != 0 || (durable && fsync(fileno(index)) != 0)) {
+        perror(index_path);
+        result = -1;
+    }
+    if (fclose(index) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+int pack_extract(const char *archive, const char *member, const char *output_filename) {
+    char *index_path = malloc(strlen(archive) + sizeof(".idx"));
+    if (!index_path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    sprintf(index_path, "%s.idx", archive);
+    FILE *index = fopen(index_path, "r");
+    if (!index) {
+        perror(index_path);
+        free(index_path);
+        return -1;
+    }
+    // find the member's block, then that block's place in the archive 
+    char line[8192];
+    int block = -1;
+    long long block_offset = -1;
+    unsigned int compressed_size = 0;
+    unsigned int original_size = 0;
+    while (fgets(line, sizeof(line), index)) {
+        line[strcspn(line, "\n")] = '\0';
+        int b, name_start = 0;
+        unsigned int offset, size;
+        if (line[0] == 'M' && sscanf(line, "M\t%d\t%u\t%u\t%n", &b, &offset, &size, &name_start) == 3 && 
+            name_start > 0 && strcmp(line + name_start, member) == 0) {
+            block = b;
+            break;
+        }
+    }
+    rewind(index);
+    while (block >= 0 && fgets(line, sizeof(line), index)) {
+        int b;
+        long long offset;
+        unsigned int size, original;
+        if (line[0] == 'B' && sscanf(line, "B\t%d\t%lld\t%u\t%u", &b, &offset, &size, &original) == 4 && 
+            b == block) {
+            block_offset = offset;
+            compressed_size = size;
+            original_size = original;
+            break;
+        }
+    }
+    fclose(index);
+    free(index_path);
+    if (block < 0 || block_offset < 0) {
+        fprintf(stderr, "%s is not in %s\n", member, archive);
+        return -1;
+    }
+    // decompress just that one block 
+    EncoderConfig bzip2_config = {CODEC_BZIP2, 9, 0, NULL, 0};
+    unsigned char *compressed = malloc(compressed_size ? compressed_size : 1);
+    unsigned char *data = malloc(original_size ? original_size : 1);
+    int fd = open(archive, O_RDONLY);
+    int result = 0;
+    if (!compressed || !data || fd < 0) {
+        perror(archive);
+        result = -1;
+    } else if (pread(fd, compressed, compressed_size, block_offset) != compressed_size) {
+        fprintf(stderr, "Short read of block %d\n", block);
+        result = -1;
+    } else if (decompress_block(compressed, compressed_size, data, original_size, 
+                                &bzip2_config) != 0) {
+        result = -1;
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(compressed);
+    // the block's own member table is what says where the bytes are 
+    const unsigned char *found = NULL;
+    unsigned int found_size = 0;
+    if (result == 0 && original_size >= 4) {
+        unsigned int count = get_u32(data);
+        // member bytes start right after the table 
+        unsigned long long entry = 4;
+        for (unsigned int m = 0; m < count && entry + 8 <= original_size; m++) {
+            entry += 8 + get_u32(data + entry);
+        }
+        unsigned long long offset = entry;
+        entry = 4;
+        for (unsigned int m = 0; m < count && entry + 8 <= original_size; m++) {
+            unsigned int name_len = get_u32(data + entry);
+            unsigned int size = get_u32(data + entry + 4);
+            if (entry + 8 + name_len > original_size || offset + size > original_size) {
+                break;
+            }
+            if (name_len == strlen(member) && memcmp(data + entry + 8, member, name_len) == 0) {
+                found = data + offset;
+                found_size = size;
+                break;
+            }
+            offset += size;
+            entry += 8 + name_len;
+        }
+        if (!found) {
+            fprintf(stderr, "Block %d of %s does not hold %s\n", block, archive, member);
+            result = -1;
+        }
+    }
+    OutputSink output;
+    if (result == 0 && sink_open(&output, output_filename, 0) == 0) {
+        if (sink_write(&output, found, found_size) != 0) {
+            perror(output_filename);
+            sink_abort(&output);
+            result = -1;
+        } else {
+            result = sink_close(&output);
+        }
+    } else if (result == 0) {
+        result = -1;
+    }
+    free(data);
+    return result;
+}
+
+void pack_free(PackPlan *plan) {
+    for (int i = 0; i < plan->num_members; i++) {
+        free(plan->members[i].path);
+        free(plan->members[i].name);
+    }
+    free(plan->members);
+    free(plan->blocks);
+    memset(plan, 0, sizeof(*plan));
+}
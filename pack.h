@@ -0,0 +1,42 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include "block.h"
+
+// one small file packed into a shared block
+typedef struct {
+    char *path; // where to read it from
+    char *name; // path relative to the packed directory
+    unsigned int size;
+    int block;
+    unsigned int offset; // where its bytes start in the uncompressed block
+} PackMember;
+
+// a block is its member table followed by the members' bytes:
+//   u32 count, then per member u32 name_len, u32 size, name
+typedef struct {
+    int first_member;
+    int num_members;
+    unsigned int size; // uncompressed size including the table
+} PackBlock;
+
+typedef struct {
+    PackMember *members;
+    int num_members;
+    PackBlock *blocks;
+    int num_blocks;
+    long long total_size; // bytes of file data
+} PackPlan;
+
+// walk dir and group its files into blocks of about block_size bytes
+int pack_scan(const char *dir, unsigned int block_size, PackPlan *plan);
+// read a block's members into a fresh buffer of plan->blocks[block].size bytes
+unsigned char *pack_build_block(const PackPlan *plan, int block);
+// archive offsets of every block and which block each member is in
+int pack_write_index(const PackPlan *plan, const CompressedBlock *blocks, 
+                     const char *index_path, int durable);
+// pull one member out of a packed archive by decompressing only its block
+int pack_extract(const char *archive, const char *member, const char *output_filename);
+void pack_free(PackPlan *plan);
+
+#endif
@@ -1,30 +1,147 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <bzlib.h>
+#include <getopt.h>
 #include <omp.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include "block.h"
+#include "bwt.h"
+#include "chunkstore.h"
+#include "codec.h"
+#include "cpu.h"
+#include "crc.h"
+#include "decompress.h"
+#include "dict.h"
+#include "energy.h"
+#include "filter.h"
+#include "logtemplate.h"
+#include "longrange.h"
+#include "pack.h"
+#include "output.h"
+#include "trace.h"
+#include "writer.h"
 
+// most destinations one compression pass can be written to 
+#define MAX_OUTPUTS 16
+// most encoder configurations one read can feed 
+#define MAX_TARGETS 8
+
+// one encoder configuration and everywhere its archive goes 
 typedef struct {
-    unsigned char *data; // where data is stored
-    unsigned int size; // bytes after compression
-    unsigned int original_size; // bytes before compression 
-} CompressedBlock;
+    EncoderConfig config;
+    const char *outputs[MAX_OUTPUTS];
+    int num_outputs;
+    int striped; // outputs share the blocks round-robin instead of each getting a copy
+    const char *manifest; // where block placements are listed (NULL = default name)
+    CompressedBlock *blocks;
+} Target;
+
 // declarations
 long get_file_size(const char *filename);
-int compress_block(unsigned char *input, unsigned int input_size, 
-                   CompressedBlock *output);
-int write_bzip2_file(const char *output_filename, CompressedBlock *blocks, 
-                     int num_blocks);
+int write_bzip2_file(Target *targets, int num_targets, int num_blocks, 
+                     const WriterOptions *options, double *write_seconds);
+int join_manifest(const char *manifest_path, const char *output_filename);
+long long parse_size(const char *text);
+int pack_directory(const char *dir, int block_size, Target *target, 
+                   const WriterOptions *options, FILE *report);
+int store_chunks(const char *store, unsigned char *file_data, long file_size, 
+                 int block_size, int num_blocks, Target *target, int durable, FILE *report);
 void cleanup_blocks(CompressedBlock *blocks, int num_blocks);
+void cleanup_targets(Target *targets, int num_targets, int num_blocks);
+// print how to call us 
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options] <input_file> <output_file|->\n"
+                    "       %s [options] [-o <output|-> ...] [--target codec[:level]:<output> ...] <input_file>\n"
+                    "       %s [options] --stripe <output> --stripe <output> [...] <input_file>\n"
+                    "       %s --join <manifest> <output_file|->\n"
+                    "       %s --chunk-store <dir> <input_file> <recipe_file>\n"
+                    "       %s --chunk-store <dir> --restore <recipe_file> <output_file|->\n"
+                    "       %s --pack <input_dir> <output_file>\n"
+                    "       %s --extract <member> <packed_file> <output_file|->\n"
+                    "       %s --train-dict <dict_file> [--dict-size size] <corpus_file_or_dir>\n"
+                    "       %s -d [--dict <dict_file>] [--mem-limit size] <input_file|-> <output_file|->\n"
+                    "Options: -b block_size_kb  --durable  --codec bz2|gz|bwt-fast|bwt-huff[:level]\n"
+                    "         --volume-size size[K|M|G]  --manifest <path>  --dict <dict_file>\n"
+                    "         --filter delta[:stride]|transpose[:width]|bcj|log  --long-range[=window]\n"
+                    "         --cpu-level generic|sse2|avx2|avx512  --trace <csv>\n"
+                    "         --block-report <csv|json>\n"
+                    "bwt-huff levels 1-5 seed each block's tables from the block its thread coded\n"
+                    "last, so their output changes with thread count and scheduling - use 6-9\n"
+                    "for byte identical archives\n",
+            prog, prog, prog, prog, prog, prog, prog, prog, prog, prog);
+}
 // main
 int main(int argc, char *argv[]) {
     // start with default size - can be overridden 
     int block_size_kb = 900;  
+    // how every output gets written - sync as we go, split into volumes 
+    WriterOptions writer_options;
+    memset(&writer_options, 0, sizeof(writer_options));
+    // reassemble an archive from a manifest instead of compressing 
+    const char *join_path = NULL;
+    // store blocks as content addressed chunks, or rebuild from a recipe 
+    const char *chunk_store = NULL;
+    const char *restore_path = NULL;
+    // input is a directory of small files packed into shared blocks 
+    int pack = 0;
+    const char *extract_member = NULL;
+    // decompress instead 
+    int decompress = 0;
+    // shared dictionary for small records - train one, or use one 
+    const char *train_dict_path = NULL;
+    const char *dict_path = NULL;
+    long long dict_size = DICT_MAX_SIZE;
+    // reversible transform run on every block before it is compressed 
+    FilterConfig filter = {FILTER_NONE, 0};
+    // replace repeats from far back in the file before the blocks are compressed 
+    long long long_range_window = 0;
+    // memory -d may use for buffers and decoder state (0 = as much as it likes) 
+    long long mem_limit = 0;
+    // per block timings for replaying the run under other schedules 
+    const char *trace_path = NULL;
+    // per block sizes, ratio, time and entropy - where a file compresses badly 
+    const char *block_report_path = NULL;
+    // slot 0 is the main archive - every -o gets a full copy of it, 
+    // each --target adds another encoding of the same blocks 
+    Target targets[MAX_TARGETS];
+    int num_targets = 1;
+    memset(targets, 0, sizeof(targets));
+    targets[0].config.codec = CODEC_BZIP2;
+    targets[0].config.level = 9;
+    // long only options 
+    enum { OPT_DURABLE = 256, OPT_CODEC, OPT_TARGET, OPT_VOLUME_SIZE, OPT_STRIPE, 
+           OPT_MANIFEST, OPT_JOIN, OPT_CHUNK_STORE, OPT_RESTORE, 
+           OPT_PACK, OPT_EXTRACT, OPT_TRAIN_DICT, OPT_DICT, OPT_DICT_SIZE, 
+           OPT_FILTER, OPT_LONG_RANGE, OPT_MEM_LIMIT, OPT_CPU_LEVEL, OPT_TRACE, 
+           OPT_BLOCK_REPORT };
+    static const struct option long_options[] = {
+        {"durable", no_argument, NULL, OPT_DURABLE},
+        {"codec", required_argument, NULL, OPT_CODEC},
+        {"target", required_argument, NULL, OPT_TARGET},
+        {"volume-size", required_argument, NULL, OPT_VOLUME_SIZE},
+        {"stripe", required_argument, NULL, OPT_STRIPE},
+        {"manifest", required_argument, NULL, OPT_MANIFEST},
+        {"join", required_argument, NULL, OPT_JOIN},
+        {"chunk-store", required_argument, NULL, OPT_CHUNK_STORE},
+        {"restore", required_argument, NULL, OPT_RESTORE},
+        {"pack", no_argument, NULL, OPT_PACK},
+        {"extract", required_argument, NULL, OPT_EXTRACT},
+        {"train-dict", required_argument, NULL, OPT_TRAIN_DICT},
+        {"dict", required_argument, NULL, OPT_DICT},
+        {"dict-size", required_argument, NULL, OPT_DICT_SIZE},
+        {"filter", required_argument, NULL, OPT_FILTER},
+        {"long-range", optional_argument, NULL, OPT_LONG_RANGE},
+        {"mem-limit", required_argument, NULL, OPT_MEM_LIMIT},
+        {"cpu-level", required_argument, NULL, OPT_CPU_LEVEL},
+        {"trace", required_argument, NULL, OPT_TRACE},
+        {"block-report", required_argument, NULL, OPT_BLOCK_REPORT},
+        {NULL, 0, NULL, 0}
+    };
     // parse command line args to look for custom block size 
     int opt;
-    while ((opt = getopt(argc, argv, "b:")) != -1) {
+    while ((opt = getopt_long(argc, argv, "b:o:d", long_options, NULL)) != -1) {
         // ascii to into
         switch (opt) {
             case 'b':
@@ -35,124 +152,650 @@ int main(int argc, char *argv[]) {
                     return 1;
                 }
                 break;
+            case 'o':
+            case OPT_STRIPE:
+                // copies and stripes of the same archive don't mix 
+                if (targets[0].num_outputs > 0 && targets[0].striped != (opt == OPT_STRIPE)) {
+                    fprintf(stderr, "-o and --stripe cannot be combined\n");
+                    return 1;
+                }
+                targets[0].striped = opt == OPT_STRIPE;
+                if (targets[0].num_outputs == MAX_OUTPUTS) {
+                    fprintf(stderr, "At most %d outputs are supported\n", MAX_OUTPUTS);
+                    return 1;
+                }
+                targets[0].outputs[targets[0].num_outputs++] = optarg;
+                break;
+            case OPT_CODEC:
+                if (parse_encoder(optarg, &targets[0].config, NULL) != 0) {
+                    return 1;
+                }
+                break;
+            case OPT_TARGET: {
+                // codec[:level]:path 
+                const char *path;
+                if (num_targets == MAX_TARGETS) {
+                    fprintf(stderr, "At most %d targets are supported\n", MAX_TARGETS - 1);
+                    return 1;
+                }
+                if (parse_encoder(optarg, &targets[num_targets].config, &path) != 0) {
+                    return 1;
+                }
+                if (!path) {
+                    fprintf(stderr, "Target '%s' has no output path\n", optarg);
+                    return 1;
+                }
+                targets[num_targets].outputs[0] = path;
+                targets[num_targets].num_outputs = 1;
+                num_targets++;
+                break;
+            }
+            case OPT_DURABLE:
+                writer_options.durable = 1;
+                break;
+            case OPT_VOLUME_SIZE:
+                writer_options.volume_size = parse_size(optarg);
+                if (writer_options.volume_size <= 0) {
+                    fprintf(stderr, "Invalid volume size\n");
+                    return 1;
+                }
+                break;
+            case OPT_MANIFEST:
+                targets[0].manifest = optarg;
+                break;
+            case OPT_JOIN:
+                join_path = optarg;
+                break;
+            case OPT_CHUNK_STORE:
+                chunk_store = optarg;
+                break;
+            case OPT_RESTORE:
+                restore_path = optarg;
+                break;
+            case OPT_PACK:
+                pack = 1;
+                break;
+            case OPT_EXTRACT:
+                extract_member = optarg;
+                break;
+            case 'd':
+                decompress = 1;
+                break;
+            case OPT_TRAIN_DICT:
+                train_dict_path = optarg;
+                break;
+            case OPT_DICT:
+                dict_path = optarg;
+                break;
+            case OPT_DICT_SIZE:
+                dict_size = parse_size(optarg);
+                if (dict_size <= 0) {
+                    fprintf(stderr, "Invalid dictionary size\n");
+                    return 1;
+                }
+                break;
+            case OPT_FILTER:
+                if (parse_filter(optarg, &filter) != 0) {
+                    return 1;
+                }
+                break;
+            case OPT_LONG_RANGE:
+                long_range_window = optarg ? parse_size(optarg) : LONG_RANGE_WINDOW;
+                if (long_range_window < (1LL << 20) || long_range_window > LONG_RANGE_MAX_WINDOW) {
+                    fprintf(stderr, "Long range window must be between 1M and 1024G\n");
+                    return 1;
+                }
+                // the decoder keeps a ring of a power of two bytes 
+                writer_options.header.window_log = 20;
+                while ((1LL << writer_options.header.window_log) < long_range_window) {
+                    writer_options.header.window_log++;
+                }
+                long_range_window = 1LL << writer_options.header.window_log;
+                break;
+            case OPT_MEM_LIMIT:
+                mem_limit = parse_size(optarg);
+                if (mem_limit <= 0) {
+                    fprintf(stderr, "Invalid memory limit\n");
+                    return 1;
+                }
+                break;
+            case OPT_TRACE:
+                trace_path = optarg;
+                break;
+            case OPT_BLOCK_REPORT:
+                block_report_path = optarg;
+                break;
+            case OPT_CPU_LEVEL: {
+                // pin the vector kernels to a lower level, to compare them 
+                CpuLevel level;
+                if (parse_cpu_level(optarg, &level) != 0) {
+                    return 1;
+                }
+                if (cpu_force_level(level) != 0) {
+                    fprintf(stderr, "CPU does not support %s (best is %s)\n", 
+                            cpu_level_name(level), cpu_level_name(cpu_detect()));
+                    return 1;
+                }
+                break;
+            }
             default:
-                fprintf(stderr, "Usage: %s [-b block_size_kb] <input_file> <output_file>\n", argv[0]);
+                usage(argv[0]);
                 return 1;
         }
     }
     // first non flag arg 
     int arg_offset = optind;
-    // check if we have input and output file 
-    if (argc - arg_offset != 2) {
-        fprintf(stderr, "Usage: %s [-b block_size_kb] <input_file> <output_file>\n", argv[0]);
+    // joining only needs somewhere to put the archive 
+    if (join_path) {
+        if (argc - arg_offset != 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return join_manifest(join_path, argv[arg_offset]) == 0 ? 0 : 1;
+    }
+    // same for rebuilding from a recipe 
+    if (restore_path) {
+        if (!chunk_store || argc - arg_offset != 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return chunk_restore(chunk_store, restore_path, argv[arg_offset]) == 0 ? 0 : 1;
+    }
+    // pulling one member out of a packed archive 
+    if (extract_member) {
+        if (argc - arg_offset != 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        return pack_extract(argv[arg_offset], extract_member, argv[arg_offset + 1]) == 0 ? 0 : 1;
+    }
+    // training samples the corpus in records of the block size 
+    if (train_dict_path) {
+        if (argc - arg_offset != 1) {
+            usage(argv[0]);
+            return 1;
+        }
+        return dict_train(argv[arg_offset], dict_size, block_size_kb * 1024, train_dict_path, 
+                          stdout) == 0 ? 0 : 1;
+    }
+    Dictionary dictionary = {NULL, 0, 0};
+    if (dict_path && dict_load(dict_path, &dictionary) != 0) {
+        return 1;
+    }
+    if (decompress) {
+        if (argc - arg_offset != 2) {
+            usage(argv[0]);
+            dict_free(&dictionary);
+            return 1;
+        }
+        // keep stats off stdout when the data itself goes there
+        FILE *report = strcmp(argv[arg_offset + 1], "-") == 0 ? stderr : stdout;
+        int result = decompress_file(argv[arg_offset], argv[arg_offset + 1], 
+                                     dict_path ? &dictionary : NULL, mem_limit, report);
+        dict_free(&dictionary);
+        return result == 0 ? 0 : 1;
+    }
+    // check if we have input and output file - output is positional unless -o or 
+    // --target named one 
+    int positional_output = targets[0].num_outputs == 0 && num_targets == 1;
+    if (argc - arg_offset != (positional_output ? 2 : 1)) {
+        usage(argv[0]);
+        dict_free(&dictionary);
         return 1;
     }
-    // store file names 
+    // store file names - output "-" is stdout
     const char *input_filename = argv[arg_offset];
-    const char *output_filename = argv[arg_offset + 1];
+    if (positional_output) {
+        targets[0].outputs[targets[0].num_outputs++] = argv[arg_offset + 1];
+    }
+    // main archive only exists if something asked for it 
+    Target *first_target = targets;
+    if (targets[0].num_outputs == 0) {
+        first_target++;
+        num_targets--;
+    }
+    FILE *report = stdout;
+    int any_pipe = 0;
+    int total_outputs = 0;
+    for (int t = 0; t < num_targets; t++) {
+        for (int i = 0; i < first_target[t].num_outputs; i++) {
+            // keep stats off stdout when the archive itself goes there
+            if (strcmp(first_target[t].outputs[i], "-") == 0) {
+                report = stderr;
+            }
+            any_pipe |= output_is_pipe(first_target[t].outputs[i]);
+            total_outputs++;
+        }
+    }
+    if (total_outputs > MAX_OUTPUTS) {
+        fprintf(stderr, "At most %d outputs are supported\n", MAX_OUTPUTS);
+        dict_free(&dictionary);
+        return 1;
+    }
+    // a dictionary goes to every gz target - their blocks then need our 
+    // container, as nothing else records which dictionary to use 
+    if (dict_path) {
+        int used = 0;
+        for (int t = 0; t < num_targets; t++) {
+            if (first_target[t].config.codec == CODEC_GZIP) {
+                first_target[t].config.dict = &dictionary;
+                first_target[t].config.container = 1;
+                used = 1;
+            }
+        }
+        if (!used) {
+            fprintf(stderr, "--dict needs a gz target (bzip2 has no dictionary support)\n");
+            dict_free(&dictionary);
+            return 1;
+        }
+    }
+    // both transforms use the block's one filter slot 
+    if (long_range_window && filter.id != FILTER_NONE) {
+        fprintf(stderr, "--long-range cannot be combined with --filter\n");
+        dict_free(&dictionary);
+        return 1;
+    }
+    // only our container records which filter to undo, and only it can 
+    // hold our own codec 
+    for (int t = 0; t < num_targets; t++) {
+        // the log filter is left off for codecs it doesn't help, so their 
+        // output stays plain 
+        int filtered = filter.id != FILTER_NONE && 
+                       (filter.id != FILTER_LOG || 
+                        log_template_helps(first_target[t].config.codec));
+        if (filter.id == FILTER_LOG && !filtered) {
+            fprintf(stderr, "Note: --filter log only helps gz, %s blocks are left unfiltered\n", 
+                    codec_name(first_target[t].config.codec));
+        }
+        if (filtered || long_range_window || 
+            first_target[t].config.codec == CODEC_BWT || 
+            first_target[t].config.codec == CODEC_BWT_HUFF) {
+            first_target[t].config.container = 1;
+        }
+    }
+    // container blocks carry headers a manifest join doesn't know about, 
+    // and only the first volume would start with the container header 
+    for (int t = 0; t < num_targets; t++) {
+        if (first_target[t].config.container && first_target[t].striped) {
+            fprintf(stderr, "--stripe cannot be used with container output\n");
+            dict_free(&dictionary);
+            return 1;
+        }
+        if (first_target[t].config.container && 
+            (writer_options.volume_size || first_target[t].manifest)) {
+            fprintf(stderr, "--volume-size and --manifest cannot be used with container output\n");
+            dict_free(&dictionary);
+            return 1;
+        }
+    }
+    // chunks are bzip2 objects and the only output is the recipe 
+    if (chunk_store && (num_targets != 1 || total_outputs != 1 || targets[0].striped || 
+                        writer_options.volume_size || first_target->config.codec != CODEC_BZIP2 || 
+                        filter.id != FILTER_NONE || long_range_window)) {
+        fprintf(stderr, "--chunk-store takes a single bz2 output (the recipe)\n");
+        dict_free(&dictionary);
+        return 1;
+    }
+    // pipes get page mapped block buffers so they can be spliced in
+    block_set_page_buffers(any_pipe);
     // convert kb to bytes 
     int BLOCK_SIZE = block_size_kb * 1024;  
+    // packing reads the files itself and needs the archive offsets to 
+    // line up with its index 
+    if (pack) {
+        if (num_targets != 1 || targets[0].striped || writer_options.volume_size || 
+            chunk_store || first_target->config.codec != CODEC_BZIP2 || 
+            filter.id != FILTER_NONE || long_range_window || 
+            strcmp(first_target->outputs[0], "-") == 0) {
+            fprintf(stderr, "--pack takes bz2 output files (no stripes, volumes, targets or filters)\n");
+            dict_free(&dictionary);
+            return 1;
+        }
+        int result = pack_directory(input_filename, BLOCK_SIZE, first_target, &writer_options, 
+                                    report);
+        dict_free(&dictionary);
+        return result == 0 ? 0 : 1;
+    }
     // open the input file 
     FILE *input_file = fopen(input_filename, "rb");
     // check if opening failed 
     if (!input_file) {
         perror("Error opening input file");
+        dict_free(&dictionary);
         return 1;
     }
     // get file size 
     long file_size = get_file_size(input_filename);
-    // calculate number of blocks needed - rounding up
-    int num_blocks = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    // calculate number of blocks needed - rounding up. an empty file still 
+    // gets one empty block, so bz2 and gz outputs are valid empty streams 
+    int num_blocks = file_size ? (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE : 1;
     // output
-    printf("File size: %ld bytes\n", file_size);
-    printf("Number of blocks: %d\n", num_blocks);
-    printf("Block size: %d bytes\n", BLOCK_SIZE);
-    // allocate memory for meta data  
-    CompressedBlock *compressed_blocks = calloc(num_blocks, sizeof(CompressedBlock));
-    // check if if calloc failed
-    if (!compressed_blocks) {
-        fprintf(stderr, "Memory allocation failed\n");
-        fclose(input_file);
-        return 1;
+    fprintf(report, "File size: %ld bytes\n", file_size);
+    fprintf(report, "Number of blocks: %d\n", num_blocks);
+    fprintf(report, "Block size: %d bytes\n", BLOCK_SIZE);
+    // allocate memory for meta data - one set of blocks per target 
+    for (int t = 0; t < num_targets; t++) {
+        first_target[t].blocks = calloc(num_blocks, sizeof(CompressedBlock));
+        // check if if calloc failed
+        if (!first_target[t].blocks) {
+            fprintf(stderr, "Memory allocation failed\n");
+            cleanup_targets(first_target, t, num_blocks);
+            fclose(input_file);
+            dict_free(&dictionary);
+            return 1;
+        }
     }
     // allocate as much memory as the size of the file in bytes 
-    unsigned char *file_data = malloc(file_size);
+    unsigned char *file_data = malloc(file_size ? file_size : 1);
     // check if malloc failed - if so free up
     if (!file_data) {
         fprintf(stderr, "Memory allocation failed for file data\n");
-        free(compressed_blocks);
+        cleanup_targets(first_target, num_targets, num_blocks);
         fclose(input_file);
+        dict_free(&dictionary);
         return 1;
     }
-    // read the entire file into memory 
+    // read the entire file into memory - once, however many targets 
+    double read_start = omp_get_wtime();
     size_t bytes_read = fread(file_data, 1, file_size, input_file);
+    double read_seconds = omp_get_wtime() - read_start;
     // check if read failed - if so free up
-    if (bytes_read != file_size) {
+    if (bytes_read != (size_t)file_size) {
         fprintf(stderr, "Error reading file\n");
         free(file_data);
-        free(compressed_blocks);
+        cleanup_targets(first_target, num_targets, num_blocks);
         fclose(input_file);
+        dict_free(&dictionary);
         return 1;
     }
     fclose(input_file);
+    // chunk store mode does its own compression and writing 
+    if (chunk_store) {
+        int result = store_chunks(chunk_store, file_data, file_size, BLOCK_SIZE, num_blocks, 
+                                  first_target, writer_options.durable, report);
+        cleanup_targets(first_target, num_targets, num_blocks);
+        free(file_data);
+        dict_free(&dictionary);
+        return result == 0 ? 0 : 1;
+    }
+    RunTrace trace;
+    memset(&trace, 0, sizeof(trace));
+    if (trace_path || block_report_path) {
+        if (trace_init(&trace, num_blocks, num_targets, block_report_path != NULL) != 0) {
+            cleanup_targets(first_target, num_targets, num_blocks);
+            free(file_data);
+            dict_free(&dictionary);
+            return 1;
+        }
+        trace.block_size = BLOCK_SIZE;
+        trace.read_seconds = read_seconds;
+    }
+    // energy from here until the archive is written, where the cpu tells us 
+    EnergyMeter energy;
+    energy_start(&energy);
     // get current time 
     double start_time = omp_get_wtime();
     // count for how many blocks failed to compress 
     int compression_errors = 0;
-    // create threads - iterations distributed dynamicly 
-    #pragma omp parallel for schedule(dynamic)
-    for (int i = 0; i < num_blocks; i++) {
-        // calculate where in the file the block starts and assume full size 
-        unsigned int offset = i * BLOCK_SIZE;
-        unsigned int block_size = BLOCK_SIZE;
-        // handle the last block - most likely smaller 
-        if (offset + block_size > file_size) {
-            block_size = file_size - offset;
-        }
-        // compress block!
-        int result = compress_block(file_data + offset, block_size, 
-                                   &compressed_blocks[i]);
-        // check if compression failed if so increase count 
-        if (result != 0) {
-            #pragma omp atomic
-            compression_errors++;
+    // container blocks carry the crc of their original bytes - it only 
+    // depends on the block, so it is taken once rather than per target 
+    unsigned int *block_crcs = NULL;
+    for (int t = 0; t < num_targets; t++) {
+        if (first_target[t].config.container) {
+            block_crcs = malloc((num_blocks ? num_blocks : 1) * sizeof(unsigned int));
+            if (!block_crcs) {
+                fprintf(stderr, "Memory allocation failed\n");
+                trace_free(&trace);
+                cleanup_targets(first_target, num_targets, num_blocks);
+                free(file_data);
+                dict_free(&dictionary);
+                return 1;
+            }
+            break;
         }
     }
-    printf("\n");
+    if (block_crcs) {
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < num_blocks; i++) {
+            unsigned int offset = i * BLOCK_SIZE;
+            unsigned int block_size = BLOCK_SIZE;
+            if (offset + block_size > file_size) {
+                block_size = file_size - offset;
+            }
+            block_crcs[i] = crc32_bzip2(file_data + offset, block_size);
+        }
+    }
+    // filter stage - every block is transformed on its own so they still 
+    // decode independently, and all targets compress the same filtered copy 
+    unsigned char *block_source = file_data;
+    // the log filter changes block sizes, so each block gets its own buffer - 
+    // NULL where a block would not shrink and is compressed as it is 
+    unsigned char **log_streams = NULL;
+    unsigned int *log_sizes = NULL;
+    int log_targets = 0;
+    for (int t = 0; t < num_targets && filter.id == FILTER_LOG; t++) {
+        log_targets += log_template_helps(first_target[t].config.codec);
+    }
+    if (log_targets) {
+        log_streams = calloc(num_blocks ? num_blocks : 1, sizeof(unsigned char *));
+        log_sizes = calloc(num_blocks ? num_blocks : 1, sizeof(unsigned int));
+        if (!log_streams || !log_sizes) {
+            fprintf(stderr, "Memory allocation failed for filtered data\n");
+            free(log_streams);
+            free(log_sizes);
+            free(block_crcs);
+            trace_free(&trace);
+            cleanup_targets(first_target, num_targets, num_blocks);
+            free(file_data);
+            dict_free(&dictionary);
+            return 1;
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < num_blocks; i++) {
+            unsigned int offset = i * BLOCK_SIZE;
+            unsigned int block_size = BLOCK_SIZE;
+            if (offset + block_size > file_size) {
+                block_size = file_size - offset;
+            }
+            log_streams[i] = log_template_encode(file_data + offset, block_size, &log_sizes[i]);
+        }
+    } else if (filter.id != FILTER_NONE && filter.id != FILTER_LOG) {
+        block_source = malloc(file_size ? file_size : 1);
+        if (!block_source) {
+            fprintf(stderr, "Memory allocation failed for filtered data\n");
+            free(block_crcs);
+            trace_free(&trace);
+            cleanup_targets(first_target, num_targets, num_blocks);
+            free(file_data);
+            dict_free(&dictionary);
+            return 1;
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (int i = 0; i < num_blocks; i++) {
+            unsigned int offset = i * BLOCK_SIZE;
+            unsigned int block_size = BLOCK_SIZE;
+            if (offset + block_size > file_size) {
+                block_size = file_size - offset;
+            }
+            filter_encode(&filter, file_data + offset, block_source + offset, block_size);
+        }
+    }
+    // long range stage - blocks with distant repeats are swapped for tokens 
+    LongRangePlan plan = {NULL, NULL, 0, 0};
+    if (long_range_window && long_range_plan(file_data, file_size, BLOCK_SIZE, num_blocks, 
+                                             long_range_window, &plan) != 0) {
+        free(block_crcs);
+        trace_free(&trace);
+        cleanup_targets(first_target, num_targets, num_blocks);
+        free(file_data);
+        dict_free(&dictionary);
+        return 1;
+    }
+    // create threads - iterations distributed dynamicly, every target of a 
+    // block is handed out next to each other while it is still in cache 
+    #pragma omp parallel
+    {
+        #pragma omp for schedule(dynamic) collapse(2)
+        for (int i = 0; i < num_blocks; i++) {
+            for (int t = 0; t < num_targets; t++) {
+                // calculate where in the file the block starts and assume full size 
+                unsigned int offset = i * BLOCK_SIZE;
+                unsigned int block_size = BLOCK_SIZE;
+                // handle the last block - most likely smaller 
+                if (offset + block_size > file_size) {
+                    block_size = file_size - offset;
+                }
+                double block_start = omp_get_wtime();
+                // pick what the codec gets - the filtered block, its long range 
+                // tokens or its log streams 
+                unsigned char *source = block_source + offset;
+                unsigned int source_size = block_size;
+                int block_filter = filter.id;
+                if (plan.tokens && plan.tokens[i]) {
+                    source = plan.tokens[i];
+                    source_size = plan.token_size[i];
+                    block_filter = FILTER_LONG_RANGE;
+                } else if (filter.id == FILTER_LOG) {
+                    if (log_streams && log_streams[i] && 
+                        log_template_helps(first_target[t].config.codec)) {
+                        source = log_streams[i];
+                        source_size = log_sizes[i];
+                    } else {
+                        block_filter = FILTER_NONE;
+                    }
+                }
+                // compress block! - log streams section by section 
+                int result = block_filter == FILTER_LOG ? 
+                             log_template_compress(source, source_size, &first_target[t].blocks[i], 
+                                                   &first_target[t].config) : 
+                             compress_block(source, source_size, 
+                                            &first_target[t].blocks[i], &first_target[t].config);
+                first_target[t].blocks[i].original_size = block_size;
+                first_target[t].blocks[i].filter = block_filter;
+                first_target[t].blocks[i].filter_param = 
+                    block_filter == FILTER_LOG ? LOG_PARAM_SECTIONS : 
+                    block_filter == (int)filter.id ? filter.param : 0;
+                if (first_target[t].config.container) {
+                    first_target[t].blocks[i].crc = block_crcs[i];
+                }
+                if (trace.timings) {
+                    trace_block(&trace, i, t, block_start - start_time, 
+                                omp_get_wtime() - start_time);
+                }
+                if (trace.entropy && t == 0) {
+                    trace.entropy[i] = byte_entropy(file_data + offset, block_size);
+                }
+                // check if compression failed if so increase count 
+                if (result != 0) {
+                    #pragma omp atomic
+                    compression_errors++;
+                }
+            }
+        }
+        // drop the zlib streams and huffman seeds this thread kept between blocks 
+        codec_thread_cleanup();
+    }
+    fprintf(report, "\n");
+    if (block_source != file_data) {
+        free(block_source);
+    }
+    long_range_free(&plan, num_blocks);
+    free(block_crcs);
+    if (log_streams) {
+        for (int i = 0; i < num_blocks; i++) {
+            free(log_streams[i]);
+        }
+        free(log_streams);
+        free(log_sizes);
+    }
     // get the current time and calculate how long compression took 
     double end_time = omp_get_wtime();
     double compression_time = end_time - start_time;
     // check if any blocks didnt compress if yes free up comp block memory and file data 
     if (compression_errors > 0) {
         fprintf(stderr, "Compression failed for %d blocks\n", compression_errors);
-        cleanup_blocks(compressed_blocks, num_blocks);
+        trace_free(&trace);
+        cleanup_targets(first_target, num_targets, num_blocks);
         free(file_data);
+        dict_free(&dictionary);
         return 1;
     }
     // write all compressed blocks to output file - if it fails clean it up 
-    if (write_bzip2_file(output_filename, compressed_blocks, num_blocks) != 0) {
+    if (write_bzip2_file(first_target, num_targets, num_blocks, &writer_options, 
+                         trace.write_seconds) != 0) {
         fprintf(stderr, "Failed to write output file\n");
-        cleanup_blocks(compressed_blocks, num_blocks);
+        trace_free(&trace);
+        cleanup_targets(first_target, num_targets, num_blocks);
         free(file_data);
+        dict_free(&dictionary);
         return 1;
     }
-    // add up all the compressed block sizes 
-    long total_compressed = 0;
-    for (int i = 0; i < num_blocks; i++) {
-        total_compressed += compressed_blocks[i].size;
+    double package_joules = -1;
+    double dram_joules = -1;
+    energy_stop(&energy, &package_joules, &dram_joules);
+    if (trace.timings) {
+        CompressedBlock *target_blocks[MAX_TARGETS];
+        for (int t = 0; t < num_targets; t++) {
+            target_blocks[t] = first_target[t].blocks;
+        }
+        trace.compress_seconds = compression_time;
+        int traced = 0;
+        if (trace_path && trace_write(&trace, trace_path, target_blocks) != 0) {
+            traced = -1;
+        }
+        if (block_report_path && trace_write_report(&trace, block_report_path, 
+                                                    target_blocks) != 0) {
+            traced = -1;
+        }
+        trace_free(&trace);
+        if (traced != 0) {
+            cleanup_targets(first_target, num_targets, num_blocks);
+            free(file_data);
+            dict_free(&dictionary);
+            return 1;
+        }
     }
     // print stats 
-    printf("\nCompression Statistics:\n");
-    printf("Original size: %ld bytes\n", file_size);
-    printf("Compressed size: %ld bytes\n", total_compressed);
-    printf("Compression ratio: %.2f%%\n", 
-           (1.0 - (double)total_compressed / file_size) * 100);
-    printf("Compression time: %.3f seconds\n", compression_time);
-    printf("Throughput: %.2f MB/s\n", 
-           (file_size / (1024.0 * 1024.0)) / compression_time);
+    fprintf(report, "\nCompression Statistics:\n");
+    fprintf(report, "Original size: %ld bytes\n", file_size);
+    if (filter.id != FILTER_NONE) {
+        fprintf(report, "Filter: %s:%d\n", filter_name(filter.id), filter.param);
+    }
+    if (long_range_window) {
+        fprintf(report, "Long range matches: %lld (%lld bytes)\n", plan.matches, plan.matched);
+    }
+    for (int t = 0; t < num_targets; t++) {
+        // add up all the compressed block sizes 
+        long total_compressed = 0;
+        for (int i = 0; i < num_blocks; i++) {
+            total_compressed += first_target[t].blocks[i].size;
+        }
+        if (num_targets > 1) {
+            fprintf(report, "Target %s:%d (%s)\n", codec_name(first_target[t].config.codec), 
+                    first_target[t].config.level, first_target[t].outputs[0]);
+        }
+        fprintf(report, "Compressed size: %ld bytes\n", total_compressed);
+        fprintf(report, "Compression ratio: %.2f%%\n", 
+                (1.0 - (double)total_compressed / file_size) * 100);
+    }
+    fprintf(report, "CPU level: %s\n", cpu_level_name(cpu_level()));
+    fprintf(report, "Compression time: %.3f seconds\n", compression_time);
+    fprintf(report, "Throughput: %.2f MB/s\n", 
+            (file_size / (1024.0 * 1024.0)) / compression_time);
+    // per GB of input, so runs of different sizes compare 
+    double gigabytes = file_size > 0 ? file_size / 1e9 : 1;
+    if (package_joules >= 0) {
+        fprintf(report, "Package energy: %.2f J (%.2f J/GB)\n", package_joules, 
+                package_joules / gigabytes);
+    }
+    if (dram_joules >= 0) {
+        fprintf(report, "DRAM energy: %.2f J (%.2f J/GB)\n", dram_joules, 
+                dram_joules / gigabytes);
+    }
     // free all allocated memory 
-    cleanup_blocks(compressed_blocks, num_blocks);
+    cleanup_targets(first_target, num_targets, num_blocks);
     free(file_data);
+    dict_free(&dictionary);
 
     return 0;
 }
@@ -164,73 +807,428 @@ long get_file_size(const char *filename) {
     }
     return -1;
 }
-// actual compression 
-int compress_block(unsigned char *input, unsigned int input_size, 
-                   CompressedBlock *output) {
-    // allocate output buffer a little bigger in case of expansion              
-    unsigned int output_buffer_size = input_size + (input_size / 100) + 600;
-    // allocate the buffer 
-    output->data = malloc(output_buffer_size);
-    // check if we ran out of memory 
-    if (!output->data) {
-        fprintf(stderr, "Memory allocation failed in compress_block\n");
+// list where every block of a target went so split or striped archives 
+// can be put back together 
+static int write_manifest(const Target *target, BlockWriter *writers, int num_writers, 
+                          int durable) {
+    char *default_path = NULL;
+    const char *path = target->manifest;
+    if (!path) {
+        default_path = malloc(strlen(target->outputs[0]) + sizeof(".manifest"));
+        if (!default_path) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        sprintf(default_path, "%s.manifest", target->outputs[0]);
+        path = default_path;
+    }
+    FILE *manifest = fopen(path, "w");
+    if (!manifest) {
+        perror(path);
+        free(default_path);
         return -1;
     }
-    // fill in the struct fields 
-    output->size = output_buffer_size;
-    output->original_size = input_size;
-    // call bzip2 library for compression
-    int result = BZ2_bzBuffToBuffCompress(
-        (char *)output->data,
-        &output->size,
-        (char *)input,
-        input_size,
-        9,  
-        0,  
-        30  
-    );
-    // check if compression failed, if so free buffer 
-    if (result != BZ_OK) {
-        fprintf(stderr, "BZ2_bzBuffToBuffCompress failed with error %d\n", result);
-        free(output->data);
-        output->data = NULL;
+    fprintf(manifest, "# parallel_bzip2 manifest v1\n");
+    fprintf(manifest, "# block\tfile\toffset\tsize\toriginal_size\n");
+    for (int w = 0; w < num_writers; w++) {
+        writer_print_manifest(&writers[w], manifest);
+    }
+    int result = 0;
+    if (fflush(manifest) != 0 || (durable && fsync(fileno(manifest)) != 0)) {
+        perror(path);
+        result = -1;
+    }
+    if (fclose(manifest) != 0) {
+        result = -1;
+    }
+    free(default_path);
+    return result;
+}
+// write all compressed blocks to every output file of every target 
+// write_seconds (when not NULL) gets the time each block took to write, 
+// summed over its outputs 
+int write_bzip2_file(Target *targets, int num_targets, int num_blocks, 
+                     const WriterOptions *options, double *write_seconds) {
+    BlockWriter writers[MAX_OUTPUTS];
+    Target *writer_target[MAX_OUTPUTS];
+    // writer w takes blocks i where i % writer_stride[w] == writer_phase[w] 
+    int writer_stride[MAX_OUTPUTS];
+    int writer_phase[MAX_OUTPUTS];
+    int num_writers = 0;
+    int total_outputs = 0;
+    int result = 0;
+    for (int t = 0; t < num_targets; t++) {
+        total_outputs += targets[t].num_outputs;
+    }
+    // one writer thread per destination - pages can only be gifted to a 
+    // pipe when no other writer still reads them 
+    WriterOptions writer_options = *options;
+    writer_options.gift = total_outputs == 1;
+    for (int t = 0; t < num_targets && result == 0; t++) {
+        // container targets start with a header saying how to decode them 
+        writer_options.container = targets[t].config.container;
+        writer_options.header.flags = CONTAINER_FLAG_CRC | 
+                                      (targets[t].config.dict ? CONTAINER_FLAG_DICT : 0) | 
+                                      (options->header.window_log ? CONTAINER_FLAG_LONG_RANGE : 0);
+        writer_options.header.dict_id = targets[t].config.dict ? targets[t].config.dict->id : 0;
+        for (int o = 0; o < targets[t].num_outputs; o++) {
+            if (writer_start(&writers[num_writers], targets[t].outputs[o], 
+                             &writer_options) != 0) {
+                result = -1;
+                break;
+            }
+            writer_target[num_writers] = &targets[t];
+            writer_stride[num_writers] = targets[t].striped ? targets[t].num_outputs : 1;
+            writer_phase[num_writers] = targets[t].striped ? o : 0;
+            num_writers++;
+        }
+    }
+    // fan each block out to its writers - a slow one only holds us up 
+    // once its queue is full 
+    for (int i = 0; i < num_blocks && result == 0; i++) {
+        int wanted = 0;
+        int alive = 0;
+        for (int w = 0; w < num_writers; w++) {
+            if (i % writer_stride[w] != writer_phase[w]) {
+                continue;
+            }
+            wanted++;
+            if (writer_push(&writers[w], &writer_target[w]->blocks[i], i) == 0) {
+                alive++;
+            }
+        }
+        // check if every destination failed 
+        if (wanted > 0 && alive == 0) {
+            fprintf(stderr, "Write error for block %d\n", i);
+            result = -1;
+        }
+    }
+    // wait for all writers to drain, any failure fails the run 
+    for (int w = 0; w < num_writers; w++) {
+        if (writer_finish(&writers[w]) != 0) {
+            fprintf(stderr, "Failed to write %s\n", writers[w].path);
+            result = -1;
+        }
+    }
+    // split and striped targets get a manifest of where each block went 
+    for (int t = 0, w = 0; t < num_targets && result == 0; t++) {
+        int first = w;
+        while (w < num_writers && writer_target[w] == &targets[t]) {
+            w++;
+        }
+        if (options->volume_size || targets[t].striped || targets[t].manifest) {
+            if (write_manifest(&targets[t], &writers[first], w - first, 
+                               options->durable) != 0) {
+                result = -1;
+            }
+        }
+    }
+    // outputs only land under their names once the whole run succeeded - 
+    // otherwise every one is dropped, so no durable .partial gets renamed 
+    // over a target while another output failed 
+    for (int w = 0; w < num_writers; w++) {
+        if (writer_close(&writers[w], result == 0) != 0) {
+            result = -1;
+        }
+    }
+    for (int w = 0; w < num_writers && write_seconds; w++) {
+        for (int p = 0; p < writers[w].num_placements; p++) {
+            write_seconds[writers[w].placements[p].block] += writers[w].placements[p].seconds;
+        }
+    }
+    for (int w = 0; w < num_writers; w++) {
+        writer_cleanup(&writers[w]);
+    }
+    return result;
+}
+// one manifest row 
+typedef struct {
+    int block;
+    char *file;
+    long long offset;
+    unsigned int size;
+} ManifestEntry;
+
+static int compare_entries(const void *a, const void *b) {
+    const ManifestEntry *x = a;
+    const ManifestEntry *y = b;
+    return (x->block > y->block) - (x->block < y->block);
+}
+// copy every block listed in a manifest, in block order, into one archive 
+int join_manifest(const char *manifest_path, const char *output_filename) {
+    FILE *manifest = fopen(manifest_path, "r");
+    if (!manifest) {
+        perror(manifest_path);
         return -1;
     }
-    // shrink the buffer to actual size 
-    output->data = realloc(output->data, output->size);
+    ManifestEntry *entries = NULL;
+    int num_entries = 0;
+    int max_entries = 0;
+    int result = 0;
+    char line[4096];
+    char file[4096];
+    while (fgets(line, sizeof(line), manifest)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        ManifestEntry entry;
+        unsigned int original_size;
+        if (sscanf(line, "%d\t%4095[^\t]\t%lld\t%u\t%u", &entry.block, file, 
+                   &entry.offset, &entry.size, &original_size) != 5) {
+            fprintf(stderr, "Bad manifest line: %s", line);
+            result = -1;
+            break;
+        }
+        if (num_entries == max_entries) {
+            max_entries = max_entries ? max_entries * 2 : 256;
+            ManifestEntry *grown = realloc(entries, max_entries * sizeof(ManifestEntry));
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed\n");
+                result = -1;
+                break;
+            }
+            entries = grown;
+        }
+        entry.file = strdup(file);
+        entries[num_entries++] = entry;
+    }
+    fclose(manifest);
+    // stripes list their blocks writer by writer - put them back in order 
+    qsort(entries, num_entries, sizeof(ManifestEntry), compare_entries);
 
-    return 0;
+    OutputSink output;
+    if (result == 0 && sink_open(&output, output_filename, 0) != 0) {
+        result = -1;
+    }
+    if (result == 0) {
+        int next_block = 0;
+        int fd = -1;
+        const char *open_file = NULL;
+        unsigned char *buffer = NULL;
+        for (int i = 0; i < num_entries && result == 0; i++) {
+            // copies of a block we already wrote 
+            if (entries[i].block < next_block) {
+                continue;
+            }
+            if (entries[i].block != next_block) {
+                fprintf(stderr, "Manifest is missing block %d\n", next_block);
+                result = -1;
+                break;
+            }
+            // keep the current volume open across consecutive blocks 
+            if (!open_file || strcmp(open_file, entries[i].file) != 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                fd = open(entries[i].file, O_RDONLY);
+                if (fd < 0) {
+                    perror(entries[i].file);
+                    result = -1;
+                    break;
+                }
+                open_file = entries[i].file;
+            }
+            unsigned char *grown = realloc(buffer, entries[i].size ? entries[i].size : 1);
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed\n");
+                result = -1;
+                break;
+            }
+            buffer = grown;
+            if (pread(fd, buffer, entries[i].size, entries[i].offset) != entries[i].size) {
+                fprintf(stderr, "Short read of block %d from %s\n", entries[i].block, 
+                        entries[i].file);
+                result = -1;
+                break;
+            }
+            if (sink_write(&output, buffer, entries[i].size) != 0) {
+                perror(output_filename);
+                result = -1;
+                break;
+            }
+            next_block++;
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(buffer);
+        if (result == 0) {
+            result = sink_close(&output);
+        } else {
+            sink_abort(&output);
+        }
+    }
+    for (int i = 0; i < num_entries; i++) {
+        free(entries[i].file);
+    }
+    free(entries);
+    return result;
+}
+// pack a directory of small files into shared blocks, compress them in 
+// parallel and write the archive plus an index for single member extraction 
+int pack_directory(const char *dir, int block_size, Target *target, 
+                   const WriterOptions *options, FILE *report) {
+    PackPlan plan;
+    if (pack_scan(dir, block_size, &plan) != 0) {
+        return -1;
+    }
+    fprintf(report, "Files: %d\n", plan.num_members);
+    fprintf(report, "Data size: %lld bytes\n", plan.total_size);
+    fprintf(report, "Number of blocks: %d\n", plan.num_blocks);
+    target->blocks = calloc(plan.num_blocks ? plan.num_blocks : 1, sizeof(CompressedBlock));
+    if (!target->blocks) {
+        fprintf(stderr, "Memory allocation failed\n");
+        pack_free(&plan);
+        return -1;
+    }
+    double start_time = omp_get_wtime();
+    int errors = 0;
+    // each worker reads its block's files, so reading is parallel too 
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < plan.num_blocks; i++) {
+        unsigned char *data = pack_build_block(&plan, i);
+        if (!data || compress_block(data, plan.blocks[i].size, &target->blocks[i], 
+                                    &target->config) != 0) {
+            #pragma omp atomic
+            errors++;
+        }
+        free(data);
+    }
+    double compression_time = omp_get_wtime() - start_time;
+    int result = errors > 0 ? -1 : 0;
+    if (errors > 0) {
+        fprintf(stderr, "Packing failed for %d blocks\n", errors);
+    }
+    if (result == 0) {
+        result = write_bzip2_file(target, 1, plan.num_blocks, options, NULL);
+    }
+    // index sits next to every copy of the archive 
+    for (int o = 0; o < target->num_outputs && result == 0; o++) {
+        char *index_path = malloc(strlen(target->outputs[o]) + sizeof(".idx"));
+        if (!index_path) {
+            result = -1;
+            break;
+        }
+        sprintf(index_path, "%s.idx", target->outputs[o]);
+        result = pack_write_index(&plan, target->blocks, index_path, options->durable);
+        free(index_path);
+    }
+    if (result == 0) {
+        long total_compressed = 0;
+        for (int i = 0; i < plan.num_blocks; i++) {
+            total_compressed += target->blocks[i].size;
+        }
+        fprintf(report, "\nCompression Statistics:\n");
+        fprintf(report, "Original size: %lld bytes\n", plan.total_size);
+        fprintf(report, "Compressed size: %ld bytes\n", total_compressed);
+        fprintf(report, "Compression time: %.3f seconds\n", compression_time);
+        fprintf(report, "Throughput: %.2f MB/s\n", 
+                (plan.total_size / (1024.0 * 1024.0)) / compression_time);
+    }
+    cleanup_targets(target, 1, plan.num_blocks);
+    pack_free(&plan);
+    return result;
 }
-// write all compressed blocks to output file 
-int write_bzip2_file(const char *output_filename, CompressedBlock *blocks, 
-                     int num_blocks) {
-    // open output file for writing 
-    FILE *output = fopen(output_filename, "wb");
-    // check if it failed 
-    if (!output) {
-        perror("Error opening output file");
+// hash every block, compress and store only the chunks the store lacks, 
+// and write the recipe listing the chunks in order 
+int store_chunks(const char *store, unsigned char *file_data, long file_size, 
+                 int block_size, int num_blocks, Target *target, int durable, FILE *report) {
+    char (*names)[CHUNK_NAME_SIZE] = malloc((size_t)(num_blocks ? num_blocks : 1) * CHUNK_NAME_SIZE);
+    if (!names) {
+        fprintf(stderr, "Memory allocation failed\n");
         return -1;
     }
-    // write each blocks 
+    double start_time = omp_get_wtime();
+    int errors = 0;
+    int new_chunks = 0;
+    long new_bytes = 0;
+    #pragma omp parallel for schedule(dynamic)
     for (int i = 0; i < num_blocks; i++) {
-        size_t written = fwrite(blocks[i].data, 1, blocks[i].size, output);
-        // check if it failed 
-        if (written != blocks[i].size) {
-            fprintf(stderr, "Write error for block %d\n", i);
-            fclose(output);
-            return -1;
+        unsigned int offset = (long)i * block_size;
+        unsigned int size = block_size;
+        if (offset + size > file_size) {
+            size = file_size - offset;
         }
+        chunk_name(file_data + offset, size, names[i]);
+        // known chunk - nothing to compress 
+        if (chunk_exists(store, names[i])) {
+            continue;
+        }
+        CompressedBlock *block = &target->blocks[i];
+        if (compress_block(file_data + offset, size, block, &target->config) != 0 || 
+            chunk_put(store, names[i], block, durable) != 0) {
+            #pragma omp atomic
+            errors++;
+        } else {
+            #pragma omp atomic
+            new_chunks++;
+            #pragma omp atomic
+            new_bytes += block->size;
+        }
+        // written out already 
+        block_release(block);
     }
-
-    fclose(output);
-    return 0;
+    double compression_time = omp_get_wtime() - start_time;
+    if (errors > 0) {
+        fprintf(stderr, "Storing failed for %d blocks\n", errors);
+        free(names);
+        return -1;
+    }
+    // the recipe goes through a normal sink so --durable covers it too 
+    OutputSink recipe;
+    if (sink_open(&recipe, target->outputs[0], durable) != 0) {
+        free(names);
+        return -1;
+    }
+    char line[CHUNK_NAME_SIZE + 32];
+    int result = 0;
+    int length = snprintf(line, sizeof(line), "# parallel_bzip2 recipe v1\n");
+    result = sink_write(&recipe, (unsigned char *)line, length);
+    for (int i = 0; i < num_blocks && result == 0; i++) {
+        unsigned int size = i == num_blocks - 1 ? file_size - (long)i * block_size : block_size;
+        length = snprintf(line, sizeof(line), "%s\t%u\n", names[i], size);
+        result = sink_write(&recipe, (unsigned char *)line, length);
+    }
+    if (result != 0) {
+        perror(target->outputs[0]);
+        sink_abort(&recipe);
+    } else {
+        result = sink_close(&recipe);
+    }
+    free(names);
+    fprintf(report, "\nChunk Store Statistics:\n");
+    fprintf(report, "Original size: %ld bytes\n", file_size);
+    fprintf(report, "New chunks: %d of %d\n", new_chunks, num_blocks);
+    fprintf(report, "New compressed bytes: %ld bytes\n", new_bytes);
+    fprintf(report, "Compression time: %.3f seconds\n", compression_time);
+    fprintf(report, "Throughput: %.2f MB/s\n", 
+            (file_size / (1024.0 * 1024.0)) / compression_time);
+    return result;
+}
+// "100M" style sizes - plain numbers are bytes 
+long long parse_size(const char *text) {
+    char *end;
+    long long value = strtoll(text, &end, 10);
+    switch (*end) {
+        case 'k': case 'K': value <<= 10; end++; break;
+        case 'm': case 'M': value <<= 20; end++; break;
+        case 'g': case 'G': value <<= 30; end++; break;
+    }
+    return *end == '\0' ? value : -1;
 }
 // free all the memory 
 void cleanup_blocks(CompressedBlock *blocks, int num_blocks) {
     for (int i = 0; i < num_blocks; i++) {
-        if (blocks[i].data) {
-            free(blocks[i].data);
-        }
+        block_release(&blocks[i]);
     }
     free(blocks);
-}
\ No newline at end of file
+}
+// free the blocks of every target 
+void cleanup_targets(Target *targets, int num_targets, int num_blocks) {
+    for (int t = 0; t < num_targets; t++) {
+        if (targets[t].blocks) {
+            cleanup_blocks(targets[t].blocks, num_blocks);
+            targets[t].blocks = NULL;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+# plot_block_report.py - heatmap of a parallel_bzip2 --block-report, to see
+# where in a file it compresses well or badly
+# usage: python3 plot_block_report.py <report.csv|report.json> [target]
+import csv
+import json
+import os
+import sys
+import matplotlib.pyplot as plt
+import numpy as np
+
+if len(sys.argv) < 2:
+    sys.exit('usage: python3 plot_block_report.py <report.csv|report.json> [target]')
+path = sys.argv[1]
+target = int(sys.argv[2]) if len(sys.argv) > 2 else 0
+
+with open(path) as f:
+    rows = json.load(f) if path.endswith('.json') else list(csv.DictReader(f))
+rows = [r for r in rows if int(r['target']) == target]
+if not rows:
+    sys.exit(f'{path}: no blocks for target {target}')
+rows.sort(key=lambda r: int(r['block']))
+
+# blocks laid out row by row on a near square grid, first block top left
+n = len(rows)
+cols = int(np.ceil(np.sqrt(n)))
+grid_rows = int(np.ceil(n / cols))
+
+def grid(values):
+    cells = np.full(grid_rows * cols, np.nan)
+    cells[:n] = values
+    return cells.reshape(grid_rows, cols)
+
+ratio = [float(r['ratio']) for r in rows]
+# time per MB, so the short last block isn't flattered
+speed = [float(r['compress_seconds']) * 1e6 / max(int(r['original_size']), 1) for r in rows]
+entropy = [float(r['entropy']) for r in rows]
+panels = [(ratio, 'Compression Ratio', 'viridis'),
+          (speed, 'Compress Time (s/MB)', 'magma'),
+          (entropy, 'Entropy (bits/byte)', 'cividis')]
+
+os.makedirs('graphs', exist_ok=True)
+fig, axes = plt.subplots(1, 3, figsize=(18, 6))
+for ax, (values, title, cmap) in zip(axes, panels):
+    image = ax.imshow(grid(values), cmap=cmap, aspect='auto')
+    ax.set_title(title, fontsize=14, fontweight='bold')
+    ax.set_xticks([])
+    ax.set_yticks([])
+    fig.colorbar(image, ax=ax)
+fig.suptitle(f'Per Block Report - {os.path.basename(path)} ({rows[0]["codec"]}, {n} blocks)',
+             fontsize=16, fontweight='bold')
+plt.tight_layout()
+plt.savefig('graphs/block_heatmap.png', dpi=300, bbox_inches='tight')
+plt.close()
+print("Block heatmap created in 'graphs/block_heatmap.png'")
@@ -0,0 +1,355 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "cpu.h"
+#include "scan.h"
+#ifdef CPU_X86
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// each worker scans a chunk this size, and the lists are joined in order 
+#define SCAN_CHUNK (8LL << 20)
+#define MAGIC_MASK 0xFFFFFFFFFFFFULL
+
+static int offsets_push(OffsetList *list, long long offset) {
+    if (list->count == list->capacity) {
+        long long grown = list->capacity ? list->capacity * 2 : 64;
+        long long *offsets = realloc(list->offsets, grown * sizeof(long long));
+        if (!offsets) {
+            return -1;
+        }
+        list->offsets = offsets;
+        list->capacity = grown;
+    }
+    list->offsets[list->count++] = offset;
+    return 0;
+}
+
+void offsets_free(OffsetList *list) {
+    free(list->offsets);
+    list->offsets = NULL;
+    list->count = list->capacity = 0;
+}
+
+// big endian bits from byte i on, zero past the end 
+static uint64_t load_be64(const unsigned char *data, long long size, long long i) {
+    uint64_t value = 0;
+    for (int k = 0; k < 8; k++) {
+        value = value << 8 | (i + k < size ? data[i + k] : 0);
+    }
+    return value;
+}
+
+// ---- streams, byte aligned ----
+
+static int is_stream(const unsigned char *data, long long size, long long i) {
+    if (i + 10 > size || data[i + 3] < '1' || data[i + 3] > '9') {
+        return 0;
+    }
+    uint64_t magic = load_be64(data, size, i + 4) >> 16;
+    return magic == BZIP2_BLOCK_MAGIC || magic == BZIP2_END_MAGIC;
+}
+
+static void check_stream(const unsigned char *data, long long size, long long at,
+                         OffsetList *list, int *error) {
+    if (is_stream(data, size, at)) {
+        *error |= offsets_push(list, at);
+    }
+}
+
+// the vector part of a chunk: "BZh" at once for a vector of positions, the
+// rest only where that matched - returns where the byte loop takes over
+typedef long long (*StreamKernel)(const unsigned char *data, long long size, long long i,
+                                  long long to, OffsetList *list, int *error);
+
+static long long streams_generic(const unsigned char *data, long long size, long long i,
+                                 long long to, OffsetList *list, int *error) {
+    (void)data, (void)size, (void)to, (void)list, (void)error;
+    return i;
+}
+
+#ifdef __SSE2__
+static long long streams_sse2(const unsigned char *data, long long size, long long i,
+                              long long to, OffsetList *list, int *error) {
+    const __m128i b = _mm_set1_epi8('B');
+    const __m128i z = _mm_set1_epi8('Z');
+    const __m128i h = _mm_set1_epi8('h');
+    for (; i + 18 <= size && i + 16 <= to; i += 16) {
+        __m128i hit = _mm_and_si128(
+            _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i)), b),
+            _mm_and_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 1)), z),
+                          _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(data + i + 2)), h)));
+        unsigned int mask = _mm_movemask_epi8(hit);
+        while (mask) {
+            check_stream(data, size, i + __builtin_ctz(mask), list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+#else
+#define streams_sse2 streams_generic
+#endif
+
+#ifdef CPU_X86
+__attribute__((target("avx2")))
+static long long streams_avx2(const unsigned char *data, long long size, long long i,
+                              long long to, OffsetList *list, int *error) {
+    const __m256i b = _mm256_set1_epi8('B');
+    const __m256i z = _mm256_set1_epi8('Z');
+    const __m256i h = _mm256_set1_epi8('h');
+    for (; i + 34 <= size && i + 32 <= to; i += 32) {
+        __m256i hit = _mm256_and_si256(
+            _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i)), b),
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 1)), z),
+                _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(data + i + 2)), h)));
+        unsigned int mask = _mm256_movemask_epi8(hit);
+        while (mask) {
+            check_stream(data, size, i + __builtin_ctz(mask), list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static long long streams_avx512(const unsigned char *data, long long size, long long i,
+                                long long to, OffsetList *list, int *error) {
+    const __m512i b = _mm512_set1_epi8('B');
+    const __m512i z = _mm512_set1_epi8('Z');
+    const __m512i h = _mm512_set1_epi8('h');
+    for (; i + 66 <= size && i + 64 <= to; i += 64) {
+        uint64_t mask = _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i), b) &
+                        _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i + 1), z) &
+                        _mm512_cmpeq_epi8_mask(_mm512_loadu_si512(data + i + 2), h);
+        while (mask) {
+            check_stream(data, size, i + __builtin_ctzll(mask), list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+#else
+#define streams_avx2 streams_sse2
+#define streams_avx512 streams_sse2
+#endif
+
+static const StreamKernel stream_kernels[CPU_LEVELS] = {
+    streams_generic, streams_sse2, streams_avx2, streams_avx512
+};
+
+static int scan_streams_chunk(const unsigned char *data, long long size, long long from,
+                              long long to, OffsetList *list) {
+    int error = 0;
+    long long i = stream_kernels[cpu_level()](data, size, from, to, list, &error);
+    for (; i < to; i++) {
+        if (i + 3 <= size && data[i] == 'B' && data[i + 1] == 'Z' && data[i + 2] == 'h') {
+            check_stream(data, size, i, list, &error);
+        }
+    }
+    return error ? -1 : 0;
+}
+
+// ---- magic at any bit offset ----
+
+// the magic shifted s bits right has whole bytes at 1 and 2 for every s -
+// one compare pair per shift covers all 8 alignments of a vector
+typedef struct {
+    uint64_t magic;
+    long long from_bit;
+    long long to_bit;
+    unsigned char first[8];
+    unsigned char second[8];
+} MagicSearch;
+
+typedef long long (*MagicKernel)(const unsigned char *data, long long size, long long i,
+                                 long long to, const MagicSearch *search, OffsetList *list,
+                                 int *error);
+
+// every alignment of a candidate byte, checked bit for bit
+static void check_magic(const unsigned char *data, long long size, long long at,
+                        const MagicSearch *search, OffsetList *list, int *error) {
+    uint64_t window = load_be64(data, size, at);
+    for (int s = 0; s < 8; s++) {
+        long long bit = at * 8 + s;
+        if (bit >= search->from_bit && bit < search->to_bit &&
+            (window >> (16 - s) & MAGIC_MASK) == search->magic) {
+            *error |= offsets_push(list, bit);
+        }
+    }
+}
+
+static long long magic_generic(const unsigned char *data, long long size, long long i,
+                               long long to, const MagicSearch *search, OffsetList *list,
+                               int *error) {
+    (void)data, (void)size, (void)to, (void)search, (void)list, (void)error;
+    return i;
+}
+
+#ifdef __SSE2__
+static long long magic_sse2(const unsigned char *data, long long size, long long i,
+                            long long to, const MagicSearch *search, OffsetList *list,
+                            int *error) {
+    __m128i first[8];
+    __m128i second[8];
+    for (int s = 0; s < 8; s++) {
+        first[s] = _mm_set1_epi8((char)search->first[s]);
+        second[s] = _mm_set1_epi8((char)search->second[s]);
+    }
+    for (; i + 18 <= size && i + 16 <= to; i += 16) {
+        __m128i one = _mm_loadu_si128((const __m128i *)(data + i + 1));
+        __m128i two = _mm_loadu_si128((const __m128i *)(data + i + 2));
+        __m128i hit = _mm_setzero_si128();
+        for (int s = 0; s < 8; s++) {
+            hit = _mm_or_si128(hit, _mm_and_si128(_mm_cmpeq_epi8(one, first[s]),
+                                                  _mm_cmpeq_epi8(two, second[s])));
+        }
+        unsigned int mask = _mm_movemask_epi8(hit);
+        while (mask) {
+            check_magic(data, size, i + __builtin_ctz(mask), search, list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+#else
+#define magic_sse2 magic_generic
+#endif
+
+#ifdef CPU_X86
+__attribute__((target("avx2")))
+static long long magic_avx2(const unsigned char *data, long long size, long long i,
+                            long long to, const MagicSearch *search, OffsetList *list,
+                            int *error) {
+    __m256i first[8];
+    __m256i second[8];
+    for (int s = 0; s < 8; s++) {
+        first[s] = _mm256_set1_epi8((char)search->first[s]);
+        second[s] = _mm256_set1_epi8((char)search->second[s]);
+    }
+    for (; i + 34 <= size && i + 32 <= to; i += 32) {
+        __m256i one = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+        __m256i two = _mm256_loadu_si256((const __m256i *)(data + i + 2));
+        __m256i hit = _mm256_setzero_si256();
+        for (int s = 0; s < 8; s++) {
+            hit = _mm256_or_si256(hit, _mm256_and_si256(_mm256_cmpeq_epi8(one, first[s]),
+                                                        _mm256_cmpeq_epi8(two, second[s])));
+        }
+        unsigned int mask = _mm256_movemask_epi8(hit);
+        while (mask) {
+            check_magic(data, size, i + __builtin_ctz(mask), search, list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static long long magic_avx512(const unsigned char *data, long long size, long long i,
+                              long long to, const MagicSearch *search, OffsetList *list,
+                              int *error) {
+    __m512i first[8];
+    __m512i second[8];
+    for (int s = 0; s < 8; s++) {
+        first[s] = _mm512_set1_epi8((char)search->first[s]);
+        second[s] = _mm512_set1_epi8((char)search->second[s]);
+    }
+    for (; i + 66 <= size && i + 64 <= to; i += 64) {
+        __m512i one = _mm512_loadu_si512(data + i + 1);
+        __m512i two = _mm512_loadu_si512(data + i + 2);
+        uint64_t mask = 0;
+        for (int s = 0; s < 8; s++) {
+            mask |= _mm512_mask_cmpeq_epi8_mask(_mm512_cmpeq_epi8_mask(one, first[s]),
+                                                two, second[s]);
+        }
+        while (mask) {
+            check_magic(data, size, i + __builtin_ctzll(mask), search, list, error);
+            mask &= mask - 1;
+        }
+    }
+    return i;
+}
+#else
+#define magic_avx2 magic_sse2
+#define magic_avx512 magic_sse2
+#endif
+
+static const MagicKernel magic_kernels[CPU_LEVELS] = {
+    magic_generic, magic_sse2, magic_avx2, magic_avx512
+};
+
+static int scan_magic_chunk(const unsigned char *data, long long size, long long from_bit,
+                            long long to_bit, uint64_t magic, OffsetList *list) {
+    MagicSearch search = {magic, from_bit, to_bit, {0}, {0}};
+    for (int s = 0; s < 8; s++) {
+        uint64_t shifted = magic << (8 - s);
+        search.first[s] = shifted >> 40;
+        search.second[s] = shifted >> 32;
+    }
+    int error = 0;
+    long long to = (to_bit + 7) >> 3;
+    long long i = magic_kernels[cpu_level()](data, size, from_bit >> 3, to, &search, list,
+                                              &error);
+    // the rest a byte at a time, through a sliding window
+    uint64_t window = load_be64(data, size, i);
+    for (; i < to; i++) {
+        for (int s = 0; s < 8; s++) {
+            long long bit = i * 8 + s;
+            if (bit >= from_bit && bit < to_bit && (window >> (16 - s) & MAGIC_MASK) == magic) {
+                error |= offsets_push(list, bit);
+            }
+        }
+        window = window << 8 | (i + 8 < size ? data[i + 8] : 0);
+    }
+    return error ? -1 : 0;
+}
+
+// split [from, to) into chunks, scan them in parallel and join the lists 
+static int scan_parallel(const unsigned char *data, long long size, long long from, 
+                         long long to, int bits, uint64_t magic, OffsetList *list) {
+    long long unit = bits ? SCAN_CHUNK * 8 : SCAN_CHUNK;
+    long long chunks = to > from ? (to - from + unit - 1) / unit : 0;
+    OffsetList *found = calloc(chunks ? chunks : 1, sizeof(OffsetList));
+    if (!found) {
+        return -1;
+    }
+    int errors = 0;
+    #pragma omp parallel for schedule(dynamic)
+    for (long long c = 0; c < chunks; c++) {
+        long long start = from + c * unit;
+        long long end = start + unit < to ? start + unit : to;
+        int result = bits ? scan_magic_chunk(data, size, start, end, magic, &found[c]) 
+                          : scan_streams_chunk(data, size, start, end, &found[c]);
+        if (result != 0) {
+            #pragma omp atomic
+            errors++;
+        }
+    }
+    for (long long c = 0; c < chunks; c++) {
+        for (long long k = 0; k < found[c].count && errors == 0; k++) {
+            if (offsets_push(list, found[c].offsets[k]) != 0) {
+                errors++;
+            }
+        }
+        offsets_free(&found[c]);
+    }
+    free(found);
+    if (errors) {
+        fprintf(stderr, "Memory allocation failed while scanning\n");
+        return -1;
+    }
+    return 0;
+}
+
+int scan_streams(const unsigned char *data, long long size, OffsetList *list) {
+    return scan_parallel(data, size, 0, size, 0, 0, list);
+}
+
+int scan_magic(const unsigned char *data, long long size, long long from_bit, 
+               long long to_bit, uint64_t magic, OffsetList *list) {
+    return scan_parallel(data, size, from_bit, to_bit, 1, magic, list);
+}
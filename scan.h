@@ -0,0 +1,26 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+
+// bzip2 magics: every block starts with the first, the end of a stream 
+// with the second, both at any bit offset 
+#define BZIP2_BLOCK_MAGIC 0x314159265359ULL
+#define BZIP2_END_MAGIC 0x177245385090ULL
+
+// candidate offsets in file order - a match may also be chance bytes in 
+// compressed data, so callers verify by decoding 
+typedef struct {
+    long long *offsets;
+    long long count;
+    long long capacity;
+} OffsetList;
+
+// byte offsets of "BZh1".."BZh9" followed by a block or end of stream magic
+int scan_streams(const unsigned char *data, long long size, OffsetList *list);
+// bit offsets in [from_bit, to_bit) where the 48 bit magic starts
+int scan_magic(const unsigned char *data, long long size, long long from_bit, 
+               long long to_bit, uint64_t magic, OffsetList *list);
+void offsets_free(OffsetList *list);
+
+#endif
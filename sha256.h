@@ -0,0 +1,22 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+typedef struct {
+    uint32_t state[8];
+    uint64_t length; // bytes hashed so far
+    unsigned char buffer[64];
+    size_t buffered;
+} Sha256;
+
+void sha256_init(Sha256 *ctx);
+void sha256_update(Sha256 *ctx, const void *data, size_t size);
+void sha256_final(Sha256 *ctx, unsigned char digest[SHA256_DIGEST_SIZE]);
+// one shot, written out as 64 lowercase hex digits
+void sha256_hex(const void *data, size_t size, char hex[2 * SHA256_DIGEST_SIZE + 1]);
+
+#endif
@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "codec.h"
+#include "trace.h"
+
+int trace_init(RunTrace *trace, int num_blocks, int num_targets, int entropy) {
+    size_t count = (size_t)(num_blocks ? num_blocks : 1) * num_targets;
+    trace->timings = calloc(count, sizeof(BlockTiming));
+    trace->write_seconds = calloc(num_blocks ? num_blocks : 1, sizeof(double));
+    trace->entropy = entropy ? calloc(num_blocks ? num_blocks : 1, sizeof(double)) : NULL;
+    trace->num_blocks = num_blocks;
+    trace->num_targets = num_targets;
+    trace->threads = omp_get_max_threads();
+    trace->block_size = 0;
+    trace->read_seconds = trace->compress_seconds = 0;
+    if (!trace->timings || !trace->write_seconds || (entropy && !trace->entropy)) {
+        fprintf(stderr, "Memory allocation failed\n");
+        trace_free(trace);
+        return -1;
+    }
+    return 0;
+}
+
+void trace_block(RunTrace *trace, int block, int target, double start, double end) {
+    BlockTiming *timing = &trace->timings[(size_t)block * trace->num_targets + target];
+    timing->start = start;
+    timing->end = end;
+    timing->thread = omp_get_thread_num();
+}
+
+int trace_write(const RunTrace *trace, const char *path, CompressedBlock *const *blocks) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "# parallel_bzip2 trace v1\n");
+    fprintf(out, "# threads %d block_size %u read_seconds %.6f compress_seconds %.6f\n",
+            trace->threads, trace->block_size, trace->read_seconds, trace->compress_seconds);
+    fprintf(out, "block,target,offset,original_size,compressed_size,thread,start,end,"
+                 "compress_seconds,write_seconds\n");
+    for (int i = 0; i < trace->num_blocks; i++) {
+        for (int t = 0; t < trace->num_targets; t++) {
+            const BlockTiming *timing = &trace->timings[(size_t)i * trace->num_targets + t];
+            const CompressedBlock *block = &blocks[t][i];
+            // the writes are per block, so they go with its first target
+            fprintf(out, "%d,%d,%llu,%u,%u,%d,%.6f,%.6f,%.6f,%.6f\n", i, t,
+                    (unsigned long long)i * trace->block_size, block->original_size,
+                    block->size, timing->thread, timing->start, timing->end,
+                    timing->end - timing->start, t == 0 ? trace->write_seconds[i] : 0.0);
+        }
+    }
+    int result = 0;
+    if (fclose(out) != 0) {
+        perror(path);
+        result = -1;
+    }
+    return result;
+}
+
+int trace_write_report(const RunTrace *trace, const char *path, 
+                       CompressedBlock *const *blocks) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror(path);
+        return -1;
+    }
+    size_t length = strlen(path);
+    int json = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+    if (json) {
+        fprintf(out, "[\n");
+    } else {
+        fprintf(out, "block,target,codec,offset,original_size,compressed_size,ratio,"
+                     "compress_seconds,entropy\n");
+    }
+    for (int i = 0; i < trace->num_blocks; i++) {
+        for (int t = 0; t < trace->num_targets; t++) {
+            const BlockTiming *timing = &trace->timings[(size_t)i * trace->num_targets + t];
+            const CompressedBlock *block = &blocks[t][i];
+            unsigned long long offset = (unsigned long long)i * trace->block_size;
+            double ratio = block->size ? (double)block->original_size / block->size : 0;
+            double entropy = trace->entropy ? trace->entropy[i] : 0;
+            if (json) {
+                int last = i == trace->num_blocks - 1 && t == trace->num_targets - 1;
+                fprintf(out, "  {\"block\": %d, \"target\": %d, \"codec\": \"%s\", "
+                             "\"offset\": %llu, \"original_size\": %u, "
+                             "\"compressed_size\": %u, \"ratio\": %.4f, "
+                             "\"compress_seconds\": %.6f, \"entropy\": %.4f}%s\n",
+                        i, t, codec_name(block->codec), offset, block->original_size, 
+                        block->size, ratio, timing->end - timing->start, entropy, 
+                        last ? "" : ",");
+            } else {
+                fprintf(out, "%d,%d,%s,%llu,%u,%u,%.4f,%.6f,%.4f\n", i, t, 
+                        codec_name(block->codec), offset, block->original_size, block->size, 
+                        ratio, timing->end - timing->start, entropy);
+            }
+        }
+    }
+    if (json) {
+        fprintf(out, "]\n");
+    }
+    int result = 0;
+    if (fclose(out) != 0) {
+        perror(path);
+        result = -1;
+    }
+    return result;
+}
+
+void trace_free(RunTrace *trace) {
+    free(trace->timings);
+    free(trace->write_seconds);
+    free(trace->entropy);
+    trace->timings = NULL;
+    trace->write_seconds = NULL;
+    trace->entropy = NULL;
+}
@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "block.h"
+
+// when and where one block was compressed, in seconds since compression
+// started
+typedef struct {
+    double start;
+    double end;
+    int thread;
+} BlockTiming;
+
+// per block costs of one run, so scheduling policies can be replayed
+// offline (bench/simulate.py) without rerunning the compressor, and where
+// a file compresses well or badly can be mapped (--block-report)
+typedef struct {
+    BlockTiming *timings; // num_blocks * num_targets, block major
+    double *write_seconds; // per block, summed over every output it went to
+    double *entropy; // per block order 0 bits per byte (block report only)
+    int num_blocks;
+    int num_targets;
+    int threads;
+    unsigned int block_size;
+    double read_seconds; // reading the whole input
+    double compress_seconds; // the parallel compression phase
+} RunTrace;
+
+int trace_init(RunTrace *trace, int num_blocks, int num_targets, int entropy);
+// stamp the timing of block / target - called from the compressing thread
+void trace_block(RunTrace *trace, int block, int target, double start, double end);
+// csv, one row per block and target, with the run described in # lines
+// blocks[t] are the blocks of target t
+int trace_write(const RunTrace *trace, const char *path, CompressedBlock *const *blocks);
+// offset, sizes, ratio, time and entropy of every block and target - json
+// when path ends in .json, csv otherwise
+int trace_write_report(const RunTrace *trace, const char *path, 
+                       CompressedBlock *const *blocks);
+void trace_free(RunTrace *trace);
+
+#endif
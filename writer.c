@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <omp.h>
+#include "crc.h"
+#include "writer.h"
+
+// volumes are numbered from 1 - path.001, path.002, ...
+static char *volume_name(const char *path, int volume) {
+    char *name = malloc(strlen(path) + 16);
+    if (name) {
+        sprintf(name, "%s.%03d", path, volume);
+    }
+    return name;
+}
+
+static int open_volume(BlockWriter *writer) {
+    if (writer->options.volume_size == 0) {
+        return sink_open(&writer->sink, writer->path, writer->options.durable);
+    }
+    free(writer->volume_path);
+    writer->volume_path = volume_name(writer->path, ++writer->volume);
+    if (!writer->volume_path) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    return sink_open(&writer->sink, writer->volume_path, writer->options.durable);
+}
+
+static int record_placement(BlockWriter *writer, const QueuedBlock *queued) {
+    if (writer->num_placements == writer->max_placements) {
+        int grown = writer->max_placements ? writer->max_placements * 2 : 256;
+        Placement *placements = realloc(writer->placements, (size_t)grown * sizeof(Placement));
+        if (!placements) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return -1;
+        }
+        writer->placements = placements;
+        writer->max_placements = grown;
+    }
+    Placement *placement = &writer->placements[writer->num_placements++];
+    placement->block = queued->index;
+    placement->volume = writer->volume;
+    placement->offset = writer->sink.written;
+    placement->size = queued->block->size;
+    placement->original_size = queued->block->original_size;
+    placement->seconds = 0;
+    return 0;
+}
+
+static int write_block(BlockWriter *writer, const QueuedBlock *queued) {
+    const CompressedBlock *block = queued->block;
+    long long limit = writer->options.volume_size;
+    int crc = writer->options.container && (writer->options.header.flags & CONTAINER_FLAG_CRC);
+    unsigned int framed_size = block->size + (writer->options.container ? BLOCK_HEADER_SIZE : 0) + 
+                               (crc ? CRC_SIZE : 0);
+    // start the next volume rather than cut a block in two 
+    if (limit && writer->sink.written > 0 && writer->sink.written + framed_size > limit) {
+        if (sink_close(&writer->sink) != 0 || open_volume(writer) != 0) {
+            return -1;
+        }
+    }
+    if (limit && block->size > limit) {
+        fprintf(stderr, "Warning: block %d (%u bytes) is bigger than the volume size, "
+                        "%s will exceed it\n", queued->index, block->size, writer->volume_path);
+    }
+    if (record_placement(writer, queued) != 0) {
+        return -1;
+    }
+    if (writer->options.container) {
+        unsigned char header[BLOCK_HEADER_SIZE];
+        BlockHeader block_header;
+        container_describe(block, &block_header);
+        container_put_block(header, &block_header);
+        if (sink_write(&writer->sink, header, sizeof(header)) != 0) {
+            return -1;
+        }
+    }
+    if (sink_write_block(&writer->sink, block) != 0) {
+        return -1;
+    }
+    if (!crc) {
+        return 0;
+    }
+    unsigned char trailer[CRC_SIZE];
+    put_u32(trailer, block->crc);
+    writer->stream_crc = crc32_bzip2_combine(writer->stream_crc, block->crc, 
+                                             block->original_size);
+    return sink_write(&writer->sink, trailer, sizeof(trailer));
+}
+
+static void *writer_main(void *arg) {
+    BlockWriter *writer = arg;
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (writer->count == 0 && !writer->done) {
+            pthread_cond_wait(&writer->not_empty, &writer->lock);
+        }
+        if (writer->count == 0) {
+            break;
+        }
+        QueuedBlock queued = writer->queue[writer->head];
+        int failed = writer->failed;
+        pthread_mutex_unlock(&writer->lock);
+        // write outside the lock so the producer can keep queueing
+        double start = omp_get_wtime();
+        if (!failed && write_block(writer, &queued) != 0) {
+            perror(writer->sink.path);
+            failed = 1;
+        } else if (!failed) {
+            writer->placements[writer->num_placements - 1].seconds = omp_get_wtime() - start;
+        }
+        pthread_mutex_lock(&writer->lock);
+        writer->failed = failed;
+        writer->head = (writer->head + 1) % writer->depth;
+        writer->count--;
+        pthread_cond_signal(&writer->not_full);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+int writer_start(BlockWriter *writer, const char *path, const WriterOptions *options) {
+    memset(writer, 0, sizeof(*writer));
+    writer->path = path;
+    writer->options = *options;
+    writer->depth = WRITER_QUEUE_DEPTH;
+    writer->queue = calloc((size_t)writer->depth, sizeof(*writer->queue));
+    if (!writer->queue) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+    if (open_volume(writer) != 0) {
+        writer_cleanup(writer);
+        return -1;
+    }
+    // the container header opens the first volume 
+    if (options->container) {
+        unsigned char header[CONTAINER_HEADER_SIZE];
+        container_put_header(header, &options->header);
+        if (sink_write(&writer->sink, header, sizeof(header)) != 0) {
+            perror(path);
+            sink_abort(&writer->sink);
+            writer_cleanup(writer);
+            return -1;
+        }
+    }
+    writer->sink.gift = options->gift;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->not_empty, NULL);
+    pthread_cond_init(&writer->not_full, NULL);
+    if (pthread_create(&writer->thread, NULL, writer_main, writer) != 0) {
+        fprintf(stderr, "Could not start writer thread for %s\n", path);
+        sink_abort(&writer->sink);
+        writer_cleanup(writer);
+        return -1;
+    }
+    return 0;
+}
+
+int writer_push(BlockWriter *writer, const CompressedBlock *block, int index) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->count == writer->depth) {
+        pthread_cond_wait(&writer->not_full, &writer->lock);
+    }
+    int failed = writer->failed;
+    if (!failed) {
+        QueuedBlock *slot = &writer->queue[(writer->head + writer->count) % writer->depth];
+        slot->block = block;
+        slot->index = index;
+        writer->count++;
+        pthread_cond_signal(&writer->not_empty);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return failed ? -1 : 0;
+}
+
+int writer_finish(BlockWriter *writer) {
+    pthread_mutex_lock(&writer->lock);
+    writer->done = 1;
+    pthread_cond_signal(&writer->not_empty);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->thread, NULL);
+
+    // and the end marker closes the last one 
+    if (!writer->failed && writer->options.container) {
+        unsigned char end[BLOCK_HEADER_SIZE] = {0};
+        if (sink_write(&writer->sink, end, sizeof(end)) != 0) {
+            perror(writer->sink.path);
+            writer->failed = 1;
+        }
+    }
+    if (!writer->failed && writer->options.container && 
+        (writer->options.header.flags & CONTAINER_FLAG_CRC)) {
+        unsigned char trailer[CRC_SIZE];
+        put_u32(trailer, writer->stream_crc);
+        if (sink_write(&writer->sink, trailer, sizeof(trailer)) != 0) {
+            perror(writer->sink.path);
+            writer->failed = 1;
+        }
+    }
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->not_empty);
+    pthread_cond_destroy(&writer->not_full);
+    return writer->failed ? -1 : 0;
+}
+
+int writer_close(BlockWriter *writer, int commit) {
+    if (commit && !writer->failed) {
+        if (sink_close(&writer->sink) != 0) {
+            perror(writer->sink.path);
+            return -1;
+        }
+        return 0;
+    }
+    sink_abort(&writer->sink);
+    // durable volumes already closed were renamed into place - a failed
+    // run takes them back so no partial set is left behind
+    if (writer->options.durable && writer->volume > 1) {
+        for (int v = 1; v < writer->volume; v++) {
+            char *name = volume_name(writer->path, v);
+            if (name) {
+                unlink(name);
+                free(name);
+            }
+        }
+    }
+    return -1;
+}
+
+void writer_print_manifest(const BlockWriter *writer, FILE *manifest) {
+    for (int i = 0; i < writer->num_placements; i++) {
+        const Placement *placement = &writer->placements[i];
+        char *name = placement->volume ? volume_name(writer->path, placement->volume) : NULL;
+        fprintf(manifest, "%d\t%s\t%lld\t%u\t%u\n", placement->block, 
+                name ? name : writer->path, placement->offset, 
+                placement->size, placement->original_size);
+        free(name);
+    }
+}
+
+void writer_cleanup(BlockWriter *writer) {
+    free(writer->queue);
+    free(writer->volume_path);
+    free(writer->placements);
+    writer->queue = NULL;
+    writer->volume_path = NULL;
+    writer->placements = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdio.h>
+#include <pthread.h>
+#include "block.h"
+#include "container.h"
+#include "output.h"
+
+// blocks a writer may fall behind the producer before pushes wait on it
+#define WRITER_QUEUE_DEPTH 16
+
+typedef struct {
+    int durable; // see sink_open
+    int gift; // pipe pages may be gifted - only when nobody else reads them
+    long long volume_size; // split into path.001, path.002 ... at block boundaries (0 = off)
+    int container; // frame the blocks in our container, starting with header
+    ContainerHeader header;
+} WriterOptions;
+
+// where one block ended up
+typedef struct {
+    int block;
+    int volume; // 0 when the output is not split
+    long long offset;
+    unsigned int size;
+    unsigned int original_size;
+    double seconds; // spent writing it
+} Placement;
+
+typedef struct {
+    const CompressedBlock *block;
+    int index;
+} QueuedBlock;
+
+// one output destination drained by its own thread, so a slow target only
+// holds up the producer once its queue is full
+typedef struct {
+    const char *path;
+    WriterOptions options;
+    OutputSink sink;
+    char *volume_path; // name of the volume currently open
+    int volume;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    QueuedBlock *queue; // ring of blocks waiting to be written
+    int depth;
+    int head;
+    int count;
+    int done; // producer has pushed its last block
+    int failed; // a write failed - later pushes are dropped
+    unsigned int stream_crc; // crc of every original byte written so far
+    Placement *placements; // every block written, in order
+    int num_placements;
+    int max_placements;
+} BlockWriter;
+
+int writer_start(BlockWriter *writer, const char *path, const WriterOptions *options);
+// queue block number index, waiting while this writer's queue is full
+int writer_push(BlockWriter *writer, const CompressedBlock *block, int index);
+// wait for the queue to drain and end the output - the destination stays
+// open until writer_close
+int writer_finish(BlockWriter *writer);
+// commit the output (a durable one is synced and renamed into place), or
+// when commit is 0 or a write failed, throw it away
+int writer_close(BlockWriter *writer, int commit);
+// manifest rows for everything this writer placed
+void writer_print_manifest(const BlockWriter *writer, FILE *manifest);
+void writer_cleanup(BlockWriter *writer);
+
+#endif